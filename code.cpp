@@ -1,520 +1,3824 @@
 #include <bits/stdc++.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
-/**
- * AdvancedDS: a feature-rich container
- * Core structure: Doubly Linked List (order), plus auxiliary indices.
- *
- * Operations (typical cost):
- *  - pushBack / pushFront / popBack / popFront / front / back / top : O(1)
- *  - search / contains / getFrequency / size / empty : O(1) average
- *  - deleteVal(x) / update(old->new) : O(1) avg for locating + O(log n) to fix min/max/median/mode
- *  - getMin / getMax : O(1) (multiset begin/rbegin)
- *  - getMedian : O(1) (two multisets)
- *  - getMode : O(1)
- *  - getRandom : O(1)
- *  - traverse / getKth / reverse / rotate(k) : O(n)
- *  - sortAscending / sortDescending / nextPermutation / prevPermutation : O(n log n) or O(n); then rebuild indices
- *  - uniqueElements / removeDuplicates : O(n)
- */
+// ----------------- Random engines -----------------
+// Small UniformRandomBitGenerators usable as the Rng policy of BasicAdvancedDS.
+// Default seeds differ from run to run: a process-wide counter started from one
+// random_device draw (one syscall per process, not per engine). Pass a seed to the
+// constructor, or call seed(), for a reproducible run.
+inline uint64_t splitmix64(uint64_t &s) {
+    uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+inline uint64_t nextDefaultSeed() {
+    static atomic<uint64_t> counter{[] { random_device rd; return (uint64_t)rd() << 32 | rd(); }()};
+    uint64_t s = counter.fetch_add(1, memory_order_relaxed);
+    return splitmix64(s);
+}
 
-class AdvancedDS {
-    struct Node {
-        int val;
-        Node *prev, *next;
-        Node(int v): val(v), prev(nullptr), next(nullptr) {}
+// xoshiro256** : 32 bytes of state, 64-bit output
+struct Xoshiro256ss {
+    using result_type = uint64_t;
+    uint64_t s[4];
+
+    Xoshiro256ss() { seed(nextDefaultSeed()); }
+    explicit Xoshiro256ss(uint64_t v) { seed(v); }
+    void seed(uint64_t v) { for (auto &w : s) w = splitmix64(v); }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() {
+        uint64_t r = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return r;
+    }
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// PCG32 (XSH-RR) : 16 bytes of state, 32-bit output
+struct Pcg32 {
+    using result_type = uint32_t;
+    uint64_t state = 0, inc = 1;
+
+    Pcg32() { seed(nextDefaultSeed()); }
+    explicit Pcg32(uint64_t v) { seed(v); }
+    void seed(uint64_t v) {
+        inc = (splitmix64(v) << 1) | 1;
+        state = 0;
+        (*this)();
+        state += splitmix64(v);
+        (*this)();
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+    result_type operator()() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+};
+
+// Stateless handle onto one xoshiro256** per thread: no per-instance state at all.
+// seed() reseeds the calling thread's engine (shared by every container on it).
+struct ThreadLocalRng {
+    using result_type = uint64_t;
+    static Xoshiro256ss& engine() {
+        static thread_local Xoshiro256ss e;
+        return e;
+    }
+    void seed(uint64_t v) { engine().seed(v); }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() { return engine()(); }
+};
+
+// ----------------- Memory accounting -----------------
+// Bytes held, counted by the allocators themselves: SmallPool blocks (at their size
+// class) and pageAlloc pages are charged to the counter active on the allocating
+// thread and credited to the one active where they are freed. A container makes its
+// own counter active for the length of each update (ChargeTo), so what it holds is a
+// count, not an estimate. Nothing is counted while no counter is active.
+struct MemoryCounter {
+    static inline thread_local int64_t* active = nullptr;
+    static void charge(int64_t bytes) { if (int64_t* c = active) *c += bytes; }
+};
+struct ChargeTo {
+    int64_t* prev;
+    explicit ChargeTo(int64_t* counter): prev(MemoryCounter::active) { MemoryCounter::active = counter; }
+    ~ChargeTo() { MemoryCounter::active = prev; }
+    ChargeTo(const ChargeTo&) = delete;
+    ChargeTo& operator=(const ChargeTo&) = delete;
+};
+
+// ----------------- Small-object pool -----------------
+// Per-thread free lists for blocks up to MaxBytes, in 16-byte size classes.
+// Every block is its own ::operator new allocation, so a block may be freed on
+// any thread; the freeing thread simply caches it. Each class caches at most
+// `limit` blocks (excess goes back to the heap) and a thread's cache is released
+// when the thread exits. After warm-up, churn of tree/hash/list nodes is served
+// entirely from the cache and never reaches the global allocator.
+class SmallPool {
+public:
+    static constexpr size_t Granule = 16, MaxBytes = 512, NumClasses = MaxBytes / Granule;
+
+    static void* allocate(size_t n) {
+        MemoryCounter::charge((int64_t)blockBytes(n));
+        if (n > MaxBytes) return ::operator new(n);
+        Cache &c = cache;
+        size_t k = classOf(n);
+        if (FreeBlock* b = c.head[k]) {
+            c.head[k] = b->next;
+            c.count[k]--;
+            return b;
+        }
+        return ::operator new((k + 1) * Granule);
+    }
+    static void deallocate(void* p, size_t n) noexcept {
+        MemoryCounter::charge(-(int64_t)blockBytes(n));
+        Cache &c = cache;
+        size_t k = classOf(n);
+        if (n > MaxBytes || c.dead || c.count[k] >= c.limit) { ::operator delete(p); return; }
+        FreeBlock* b = static_cast<FreeBlock*>(p);
+        b->next = c.head[k];
+        c.head[k] = b;
+        c.count[k]++;
+        if (!c.registered) { c.registered = true; (void)reaper; }
+    }
+
+    // Return the calling thread's cached blocks to the heap
+    static void trim() noexcept {
+        Cache &c = cache;
+        for (size_t k = 0; k < NumClasses; k++) {
+            while (FreeBlock* b = c.head[k]) { c.head[k] = b->next; ::operator delete(b); }
+            c.count[k] = 0;
+        }
+    }
+    // Max cached blocks per size class for the calling thread
+    static void setCacheLimit(size_t blocks) noexcept { cache.limit = blocks; }
+    // What a request for n bytes takes: its size class
+    static size_t blockBytes(size_t n) { return n > MaxBytes ? n : (classOf(n) + 1) * Granule; }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+    // Plain data so it stays usable even after the thread's reaper has run
+    struct Cache {
+        FreeBlock* head[NumClasses];
+        size_t count[NumClasses];
+        size_t limit = 4096;
+        bool registered, dead;
     };
+    struct Reaper { ~Reaper() { trim(); cache.dead = true; } };
 
-    // Doubly-linked list to maintain order
-    Node *head = nullptr, *tail = nullptr;
-    size_t sz = 0;
+    static size_t classOf(size_t n) { return n ? (n - 1) / Granule : 0; }
 
-    // Value -> set of node pointers (supports duplicates, O(1) erase by pointer)
-    unordered_map<int, unordered_set<Node*>> locs;
+    static thread_local Cache cache;
+    static thread_local Reaper reaper;
+};
+inline thread_local SmallPool::Cache SmallPool::cache{};
+inline thread_local SmallPool::Reaper SmallPool::reaper;
 
-    // Frequency + mode tracking
-    unordered_map<int,int> freq;
-    int modeVal = 0;
-    int modeCnt = 0;
+// Stateless std allocator on top of SmallPool (all instances compare equal)
+template<class T>
+struct PoolAlloc {
+    static_assert(alignof(T) <= SmallPool::Granule, "PoolAlloc: over-aligned type");
+    using value_type = T;
 
-    // Min/Max (all values)
-    multiset<int> allVals;
+    PoolAlloc() noexcept = default;
+    template<class U> PoolAlloc(const PoolAlloc<U>&) noexcept {}
 
-    // Median maintenance: lower = max half, upper = min half
-    multiset<int> lower, upper; // invariants: |lower| >= |upper| and |lower|-|upper|<=1
+    T* allocate(size_t n) { return static_cast<T*>(SmallPool::allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) noexcept { SmallPool::deallocate(p, n * sizeof(T)); }
+
+    template<class U> bool operator==(const PoolAlloc<U>&) const noexcept { return true; }
+    template<class U> bool operator!=(const PoolAlloc<U>&) const noexcept { return false; }
+};
 
-    // Random support: pool of node pointers + index map (swap-remove)
-    vector<Node*> pool;
-    unordered_map<Node*, size_t> poolPos;
-    mt19937 rng{random_device{}()};
+using PoolMultiset = multiset<int, less<int>, PoolAlloc<int>>;
 
-    // ---- Helpers ----
-    void attachBack(Node* node) {
-        if (!tail) head = tail = node;
+// ----------------- Allocation counting hook -----------------
+// Build with -DADVANCEDDS_COUNT_ALLOCS to route the global operator new/delete
+// through a counter; heapAllocCount() then reports process-wide allocations. Blocks
+// the containers take from calloc or mmap directly (pageAlloc, small hash tables)
+// count too.
+#ifdef ADVANCEDDS_COUNT_ALLOCS
+inline atomic<size_t> heapAllocs{0};
+inline size_t heapAllocCount() { return heapAllocs.load(memory_order_relaxed); }
+inline void countHeapAlloc() { heapAllocs.fetch_add(1, memory_order_relaxed); }
+
+void* operator new(size_t n) {
+    countHeapAlloc();
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void* operator new(size_t n, align_val_t al) {
+    countHeapAlloc();
+    size_t a = (size_t)al;
+    if (void* p = aligned_alloc(a, (n + a - 1) / a * a)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+#else
+inline size_t heapAllocCount() { return 0; }
+inline void countHeapAlloc() {}
+#endif
+
+// ----------------- Page allocation -----------------
+// Big arrays (hash tables, pool chunks) are mapped straight from the OS rather than
+// taken from the malloc heap. They arrive zero-filled on demand, and a large
+// malloc/free can no longer trigger glibc's consolidation pass over every small
+// block freed so far (a multi-millisecond stall in the middle of node churn).
+// pageRelease hands back a leading part early, so freeing can be spread out.
+constexpr size_t PageBytes = 4096, ReleaseBytes = 64 * 1024;
+inline size_t pageRound(size_t bytes) { return (bytes + PageBytes - 1) / PageBytes * PageBytes; }
+inline void* pageAlloc(size_t bytes) {
+    countHeapAlloc();
+#ifdef __linux__
+    void* p = mmap(nullptr, pageRound(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw bad_alloc();
+#else
+    void* p = calloc(1, bytes);
+    if (!p) throw bad_alloc();
+#endif
+    MemoryCounter::charge((int64_t)pageRound(bytes));
+    return p;
+}
+// Return [p, p + bytes) to the OS; p and bytes are multiples of PageBytes
+inline void pageRelease(void* p, size_t bytes) {
+    MemoryCounter::charge(-(int64_t)bytes);
+#ifdef __linux__
+    if (bytes) munmap(p, bytes);
+#else
+    (void)p; (void)bytes;   // returned with the whole block by pageFree
+#endif
+}
+// Free a pageAlloc'd block whose first `released` bytes went back already
+inline void pageFree(void* p, size_t bytes, size_t released = 0) {
+    MemoryCounter::charge(-(int64_t)(pageRound(bytes) - released));
+#ifdef __linux__
+    if (pageRound(bytes) > released) munmap((char*)p + released, pageRound(bytes) - released);
+#else
+    (void)bytes; (void)released;
+    free(p);
+#endif
+}
+
+// ----------------- Incremental hash map -----------------
+// Chained hash map that never rehashes everything at once. Outgrowing the buckets
+// allocates a table twice the size (zeroed: small ones by calloc, page-sized and up
+// by pageAlloc, which maps untouched zero pages, so no O(n) clearing) and every
+// following insert/erase moves MigrateStep old buckets across; lookups probe both
+// tables until the old one is drained. An erase that leaves it below a quarter full
+// starts the same migration into a table half the size, so the buckets follow the
+// size back down, to InitBuckets once empty. Since a migration of c buckets finishes
+// within c/4 inserts or c/8 erases, a new one never has to wait. Worst case per
+// operation: 2 * MigrateStep buckets + one chain. Entries come
+// from SmallPool and never move, so references to values stay valid.
+template<class K, class V>
+class IncrementalHashMap {
+    struct Entry {
+        Entry* next;
+        K key;
+        V val;
+    };
+    struct Table {
+        Entry** b = nullptr;
+        size_t mask = 0;
+        int shift = 64;
+        size_t from = 0;        // buckets [0, from) are empty and may be unmapped
+        size_t released = 0;    // bytes of b already returned (page tables only)
+        size_t cap() const { return b ? mask + 1 : 0; }
+        bool paged() const { return (mask + 1) * sizeof(Entry*) >= PageBytes; }
+    };
+    static constexpr size_t MigrateStep = 4, InitBuckets = 8;
+
+    Table cur, old;         // old.b != nullptr while a migration is in flight
+    size_t n = 0;
+
+    static uint64_t hashOf(const K &k) { return (uint64_t)hash<K>{}(k) * 0x9E3779B97F4A7C15ULL; }
+    static size_t slot(const Table &t, uint64_t h) { return (size_t)(h >> t.shift); }
+
+    static Table makeTable(size_t cap) {
+        Table t;
+        t.mask = cap - 1;
+        t.shift = 64 - __builtin_ctzll(cap);
+        if (t.paged()) t.b = static_cast<Entry**>(pageAlloc(cap * sizeof(Entry*)));
         else {
-            tail->next = node;
-            node->prev = tail;
-            tail = node;
+            countHeapAlloc();
+            if (!(t.b = static_cast<Entry**>(calloc(cap, sizeof(Entry*))))) throw bad_alloc();
+            MemoryCounter::charge((int64_t)(cap * sizeof(Entry*)));
         }
+        return t;
     }
-    void attachFront(Node* node) {
-        if (!head) head = tail = node;
-        else {
-            node->next = head;
-            head->prev = node;
-            head = node;
+    static void freeTable(Table &t) {
+        if (t.paged()) pageFree(t.b, t.cap() * sizeof(Entry*), t.released);
+        else if (t.b) { MemoryCounter::charge(-(int64_t)(t.cap() * sizeof(Entry*))); free(t.b); }
+        t = Table();
+    }
+    // unmap the drained prefix [0, from) in ReleaseBytes pieces
+    static void releaseDrained(Table &t) {
+        if (!t.paged()) return;
+        size_t done = t.from * sizeof(Entry*) / ReleaseBytes * ReleaseBytes;
+        if (done > t.released) {
+            pageRelease((char*)t.b + t.released, done - t.released);
+            t.released = done;
         }
     }
-    void detach(Node* node) {
-        if (node->prev) node->prev->next = node->next; else head = node->next;
-        if (node->next) node->next->prev = node->prev; else tail = node->prev;
-        node->prev = node->next = nullptr;
+    Entry* findIn(const Table &t, uint64_t h, const K &k) const {
+        if (!t.b || slot(t, h) < t.from) return nullptr;
+        for (Entry* e = t.b[slot(t, h)]; e; e = e->next)
+            if (e->key == k) return e;
+        return nullptr;
     }
-
-    void poolAdd(Node* node) {
-        poolPos[node] = pool.size();
-        pool.push_back(node);
+    Entry* findEntry(const K &k) const {
+        uint64_t h = hashOf(k);
+        Entry* e = findIn(cur, h, k);
+        return e ? e : findIn(old, h, k);
     }
-    void poolRemove(Node* node) {
-        auto it = poolPos.find(node);
-        if (it == poolPos.end()) return;
-        size_t idx = it->second;
-        size_t last = pool.size() - 1;
-        if (idx != last) {
-            pool[idx] = pool[last];
-            poolPos[pool[idx]] = idx;
+    bool unlinkFrom(Table &t, uint64_t h, const K &k) {
+        if (!t.b || slot(t, h) < t.from) return false;
+        for (Entry** pe = &t.b[slot(t, h)]; *pe; pe = &(*pe)->next) {
+            if ((*pe)->key == k) {
+                Entry* e = *pe;
+                *pe = e->next;
+                destroy(e);
+                return true;
+            }
         }
-        pool.pop_back();
-        poolPos.erase(node);
+        return false;
+    }
+    static void destroy(Entry* e) {
+        e->~Entry();
+        SmallPool::deallocate(e, sizeof(Entry));
     }
 
-    void modeInc(int x) {
-        int f = ++freq[x];
-        if (f > modeCnt || (f == modeCnt && x < modeVal)) {
-            modeCnt = f;
-            modeVal = x;
+    // Move up to `buckets` old buckets into the current table
+    void migrate(size_t buckets) {
+        if (!old.b) return;
+        size_t end = old.from + min(buckets, old.cap() - old.from);
+        for (; old.from < end; old.from++) {
+            for (Entry* e = old.b[old.from]; e; ) {
+                Entry* nxt = e->next;
+                Entry*& headRef = cur.b[slot(cur, hashOf(e->key))];
+                e->next = headRef;
+                headRef = e;
+                e = nxt;
+            }
         }
+        if (old.from == old.cap()) freeTable(old);
+        else releaseDrained(old);
     }
-    void modeDec(int x) {
-        auto it = freq.find(x);
-        if (it == freq.end()) return;
-        it->second--;
-        if (it->second == 0) freq.erase(it);
-        // Recompute mode if needed (rare path)
-        if (x == modeVal && (freq.count(x) == 0 || freq[x] < modeCnt)) {
-            modeCnt = 0;
-            for (auto &p : freq) {
-                if (p.second > modeCnt || (p.second == modeCnt && p.first < modeVal)) {
-                    modeCnt = p.second;
-                    modeVal = p.first;
-                }
+    void grow() {
+        migrate(SIZE_MAX);   // no-op: a migration always ends before the next growth
+        old = cur;
+        cur = makeTable(max(InitBuckets, old.cap() * 2));
+    }
+    // Half the buckets: at most half full, so it ends before a growth could start
+    void shrink() {
+        old = cur;
+        cur = makeTable(old.cap() / 2);
+    }
+
+public:
+    IncrementalHashMap() = default;
+    IncrementalHashMap(IncrementalHashMap &&o) noexcept { swap(o); }
+    IncrementalHashMap& operator=(IncrementalHashMap &&o) noexcept { swap(o); return *this; }
+    IncrementalHashMap(const IncrementalHashMap&) = delete;
+    IncrementalHashMap& operator=(const IncrementalHashMap&) = delete;
+    ~IncrementalHashMap() { clear(); }
+
+    void swap(IncrementalHashMap &o) noexcept {
+        std::swap(cur, o.cur);
+        std::swap(old, o.old);
+        std::swap(n, o.n);
+    }
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    bool count(const K &k) const { return findEntry(k) != nullptr; }
+
+    V* find(const K &k) {
+        Entry* e = findEntry(k);
+        return e ? &e->val : nullptr;
+    }
+    const V* find(const K &k) const {
+        Entry* e = findEntry(k);
+        return e ? &e->val : nullptr;
+    }
+    // Batched find: f(i, value pointer or nullptr) for each keys[i], in order.
+    // Keys go in groups of BatchGroup: hash all and prefetch their bucket slots,
+    // then prefetch the chain heads, then resolve, so the cache misses within a
+    // group overlap instead of being paid one after another. The prefetches stay
+    // unguarded inside the loops (GCC drops a guarded one as dead code); they never
+    // fault, not even on the unmapped prefix of a migrating table.
+    template<class F>
+    void findMany(const K* keys, size_t cnt, F &&f) const {
+        constexpr size_t BatchGroup = 16;
+        uint64_t h[BatchGroup];
+        for (size_t base = 0; base < cnt; base += BatchGroup) {
+            size_t g = min(BatchGroup, cnt - base);
+            for (size_t i = 0; i < g; i++) h[i] = hashOf(keys[base + i]);
+            for (const Table* t : {&cur, &old})
+                if (t->b)
+                    for (size_t i = 0; i < g; i++) __builtin_prefetch(&t->b[slot(*t, h[i])]);
+            if (cur.b && cur.from == 0)
+                for (size_t i = 0; i < g; i++) __builtin_prefetch(cur.b[slot(cur, h[i])]);
+            for (size_t i = 0; i < g; i++) {
+                Entry* e = findIn(cur, h[i], keys[base + i]);
+                if (!e) e = findIn(old, h[i], keys[base + i]);
+                f(base + i, e ? (const V*)&e->val : nullptr);
             }
         }
     }
 
-    void medianAdd(int x) {
-        if (lower.empty() || x <= *lower.rbegin()) lower.insert(x);
-        else upper.insert(x);
-        rebalanceMedian();
+    // Find or value-initialize
+    V& operator[](const K &k) {
+        migrate(MigrateStep);
+        if (Entry* e = findEntry(k)) return e->val;
+        if (n + 1 > cur.cap()) grow();
+        Entry* e = new (SmallPool::allocate(sizeof(Entry))) Entry{nullptr, k, V{}};
+        Entry*& headRef = cur.b[slot(cur, hashOf(k))];
+        e->next = headRef;
+        headRef = e;
+        n++;
+        return e->val;
     }
-    void medianRemove(int x) {
-        // erase one instance from the correct multiset
-        if (!lower.empty() && x <= *lower.rbegin()) {
-            auto it = lower.find(x);
-            if (it != lower.end()) lower.erase(it);
-            else {
-                auto iu = upper.find(x);
-                if (iu != upper.end()) upper.erase(iu);
-            }
+    bool erase(const K &k) {
+        migrate(2 * MigrateStep);   // a shrink of c buckets starts at c/4 entries: done by c/8
+        uint64_t h = hashOf(k);
+        if (unlinkFrom(cur, h, k) || unlinkFrom(old, h, k)) {
+            if (--n < cur.cap() / 4 && cur.cap() > InitBuckets && !old.b) shrink();
+            return true;
+        }
+        return false;
+    }
+    // Shrink now, as far as erases would in time: O(buckets)
+    void shrinkToFit() {
+        migrate(SIZE_MAX);
+        while (cur.cap() > InitBuckets && n < cur.cap() / 4) { shrink(); migrate(SIZE_MAX); }
+    }
+    // Table bytes held once emptied and shrunk back (the entries come and go)
+    size_t minBytes() const { return cur.b || old.b ? InitBuckets * sizeof(Entry*) : 0; }
+
+    // f(key, value&) for every entry, unspecified order; no inserts/erases inside f
+    template<class F>
+    void forEach(F &&f) const {
+        for (const Table* t : {&cur, &old})
+            for (size_t i = t->from; i < t->cap(); i++)
+                for (Entry* e = t->b[i]; e; e = e->next) f(e->key, e->val);
+    }
+
+    void clear() {
+        for (Table* t : {&cur, &old}) {
+            for (size_t i = t->from; i < t->cap(); i++)
+                for (Entry* e = t->b[i]; e; ) { Entry* nxt = e->next; destroy(e); e = nxt; }
+            if (t->b) freeTable(*t);
+        }
+        n = 0;
+    }
+    // clear() in installments: free the chains of up to `buckets` buckets, unmapping
+    // table pages as they empty, and take them off `buckets`. No inserts until it
+    // returns true (map empty, tables gone).
+    bool drain(size_t &buckets) {
+        for (Table* t : {&old, &cur}) {
+            if (!t->b) continue;
+            for (; buckets > 0 && t->from < t->cap(); buckets--, t->from++)
+                for (Entry* e = t->b[t->from]; e; n--) { Entry* nxt = e->next; destroy(e); e = nxt; }
+            if (t->from < t->cap()) { releaseDrained(*t); return false; }
+            freeTable(*t);
+        }
+        return true;
+    }
+};
+
+// ----------------- Chunked vector -----------------
+// Random-access array built from chunks of Base, Base, 2*Base, 4*Base, ... elements.
+// Growing maps one more chunk (pageAlloc) and never copies existing elements; index
+// lookup is a bit-scan. Once the size falls to half the chunk before it, the last
+// chunk is unmapped a ReleaseBytes piece per push or pop, so memory follows the size
+// down without a stall. At most 64 chunks, so the directory is a fixed-size array,
+// allocated with the first chunk to keep empty instances small.
+template<class T, size_t Base = 512>
+class ChunkedVector {
+    static_assert((Base & (Base - 1)) == 0, "Base must be a power of two");
+    static_assert(is_trivially_copyable<T>::value, "ChunkedVector holds trivially copyable types");
+
+    static constexpr int MaxChunks = 64;
+    T** chunks = nullptr;
+    int nchunks = 0;
+    size_t n = 0, cap = 0;
+    size_t lastReleased = 0;    // bytes of the last chunk already unmapped (drain, retire)
+
+    static size_t chunkSize(int c) { return c == 0 ? Base : Base << (c - 1); }
+    static size_t chunkStart(int c) { return c == 0 ? 0 : Base << (c - 1); }
+    static int chunkOf(size_t i) {
+        size_t q = i / Base;
+        return q == 0 ? 0 : 64 - __builtin_clzll(q);
+    }
+    // The last chunk is out of cap and being unmapped
+    bool retiring() const { return nchunks > 1 && cap == chunkStart(nchunks - 1); }
+    void retireStep() {
+        size_t bytes = pageRound(chunkSize(nchunks - 1) * sizeof(T));
+        if (bytes - lastReleased > ReleaseBytes) {
+            pageRelease((char*)chunks[nchunks - 1] + lastReleased, ReleaseBytes);
+            lastReleased += ReleaseBytes;
         } else {
-            auto iu = upper.find(x);
-            if (iu != upper.end()) upper.erase(iu);
-            else {
-                auto il = lower.find(x);
-                if (il != lower.end()) lower.erase(il);
+            nchunks--;
+            pageFree(chunks[nchunks], bytes, lastReleased);
+            lastReleased = 0;
+        }
+    }
+
+public:
+    ChunkedVector() = default;
+    ChunkedVector(ChunkedVector &&o) noexcept { swap(o); }
+    ChunkedVector& operator=(ChunkedVector &&o) noexcept { swap(o); return *this; }
+    ChunkedVector(const ChunkedVector&) = delete;
+    ChunkedVector& operator=(const ChunkedVector&) = delete;
+    ~ChunkedVector() { clear(); }
+
+    void swap(ChunkedVector &o) noexcept {
+        std::swap(chunks, o.chunks);
+        std::swap(nchunks, o.nchunks);
+        std::swap(n, o.n);
+        std::swap(cap, o.cap);
+        std::swap(lastReleased, o.lastReleased);
+    }
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+
+    T& operator[](size_t i) {
+        int c = chunkOf(i);
+        return chunks[c][i - chunkStart(c)];
+    }
+    const T& operator[](size_t i) const {
+        int c = chunkOf(i);
+        return chunks[c][i - chunkStart(c)];
+    }
+    T& back() { return (*this)[n - 1]; }
+
+    void push_back(const T &v) {
+        if (retiring()) retireStep();
+        if (n == cap) {
+            while (retiring()) retireStep();    // not reached: half a chunk of pushes away
+            if (!chunks) chunks = static_cast<T**>(SmallPool::allocate(MaxChunks * sizeof(T*)));
+            chunks[nchunks] = static_cast<T*>(pageAlloc(chunkSize(nchunks) * sizeof(T)));
+            cap += chunkSize(nchunks++);
+        }
+        (*this)[n++] = v;
+    }
+    void pop_back() {
+        n--;
+        if (retiring()) retireStep();
+        else if (nchunks > 1 && n <= chunkStart(nchunks - 1) / 2) { cap = chunkStart(nchunks - 1); retireStep(); }
+    }
+    // Unmap now what pops would in time
+    void shrinkToFit() {
+        while (retiring() || (nchunks > 1 && n <= chunkStart(nchunks - 1) / 2)) {
+            cap = chunkStart(nchunks - 1);
+            retireStep();
+        }
+    }
+    // Bytes held once emptied: the first chunk and the directory
+    size_t minBytes() const {
+        return chunks ? pageRound(Base * sizeof(T)) + SmallPool::blockBytes(MaxChunks * sizeof(T*)) : 0;
+    }
+
+    void clear() {
+        while (nchunks > 0) {
+            nchunks--;
+            pageFree(chunks[nchunks], chunkSize(nchunks) * sizeof(T), lastReleased);
+            lastReleased = 0;
+        }
+        if (chunks) SmallPool::deallocate(chunks, MaxChunks * sizeof(T*));
+        chunks = nullptr;
+        n = cap = 0;
+    }
+    // clear() in installments of about ReleaseBytes each, taken off `pieces`; true once
+    // everything is freed
+    bool drain(size_t &pieces) {
+        n = 0;
+        for (; pieces > 0 && nchunks > 0; pieces--) {
+            size_t bytes = pageRound(chunkSize(nchunks - 1) * sizeof(T));
+            if (bytes - lastReleased > ReleaseBytes) {
+                pageRelease((char*)chunks[nchunks - 1] + lastReleased, ReleaseBytes);
+                lastReleased += ReleaseBytes;
+            } else {
+                nchunks--;
+                pageFree(chunks[nchunks], bytes, lastReleased);
+                lastReleased = 0;
+                cap = min(cap, chunkStart(nchunks));
             }
         }
-        rebalanceMedian();
+        if (nchunks > 0) return false;
+        clear();
+        return true;
     }
-    void rebalanceMedian() {
-        if (lower.size() > upper.size() + 1) {
-            auto it = prev(lower.end());
-            upper.insert(*it);
-            lower.erase(it);
-        } else if (upper.size() > lower.size()) {
-            auto it = upper.begin();
-            lower.insert(*it);
-            upper.erase(it);
+};
+
+// ----------------- Timing wheel -----------------
+// Hierarchical timing wheel over integer ticks: Levels levels of 64 slots, a slot
+// of level l spanning 64^l ticks. A timer is filed at the highest base-64 digit
+// where its deadline differs from the clock, so schedule and cancel are O(1).
+// advance(t) fires only occupied level-0 slots (a bitmap per level) and jumps
+// straight to the next occupied coarse slot, re-filing its timers one level down
+// on entry. Deadlines beyond the top level wait in an overflow list that is
+// re-filed whenever the top level wraps. Not movable: slots are list sentinels.
+struct WheelTimer {
+    WheelTimer *prev = nullptr, *next = nullptr;   // linked into a slot while armed
+    uint64_t deadline = 0;
+    bool armed() const { return next != nullptr; }
+};
+
+class TimingWheel {
+public:
+    static constexpr int Levels = 4, SlotBits = 6;
+    static constexpr uint64_t Slots = 1 << SlotBits;
+
+    explicit TimingWheel(uint64_t start = 0): next(start + 1) { reset(); }
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // From SmallPool like the timers, so it is counted with them (MemoryCounter)
+    static void* operator new(size_t n) { return SmallPool::allocate(n); }
+    static void operator delete(void* p, size_t n) { SmallPool::deallocate(p, n); }
+
+    // Last time passed to advance() (0 initially)
+    uint64_t now() const { return next - 1; }
+
+    // Arm t to fire at the first advance() reaching deadline
+    void schedule(WheelTimer* t, uint64_t deadline) {
+        t->deadline = deadline;
+        file(t);
+    }
+    static void cancel(WheelTimer* t) {
+        if (!t->armed()) return;
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        t->prev = t->next = nullptr;
+    }
+    // Forget every timer without touching it (their owners free them); keeps the clock
+    void reset() {
+        for (auto &level : slot) for (WheelTimer &s : level) s.prev = s.next = &s;
+        overflow.prev = overflow.next = &overflow;
+        due.prev = due.next = &due;
+        fill(begin(occupied), end(occupied), 0);
+    }
+
+    // Move the clock to t, calling fire(timer) for every timer with deadline <= t.
+    // A timer is unlinked before its callback, which may cancel or schedule others.
+    // Returns the number fired.
+    template<class F>
+    size_t advance(uint64_t t, F &&fire) {
+        size_t n = fireDue(t, fire);
+        while (next <= t) {
+            uint64_t last = min(t, next | (Slots - 1));
+            uint64_t m = occupied[0] & rangeMask(next & (Slots - 1), last & (Slots - 1));
+            for (; m; m &= m - 1) {
+                int s = __builtin_ctzll(m);
+                occupied[0] &= ~(1ULL << s);
+                n += fireList(slot[0][s], fire);
+            }
+            next = last + 1;
+            if (next & (Slots - 1)) break;      // stopped inside a block: done
+            cascade();
+            if (occupied[0]) continue;
+            // level 0 is empty: skip straight to the next occupied coarse slot
+            uint64_t b = nextOccupied();
+            if (b > t + 1) { next = t + 1; break; }
+            next = b;
+            cascade();
         }
+        return n;
     }
 
-    void addValueStructures(int x, Node* node) {
-        locs[x].insert(node);
-        modeInc(x);
-        allVals.insert(x);
-        medianAdd(x);
-        poolAdd(node);
-        sz++;
+private:
+    WheelTimer slot[Levels][Slots];
+    WheelTimer overflow, due;       // due: deadline already behind the clock when filed
+    uint64_t occupied[Levels];      // may keep bits of slots emptied by cancel()
+    uint64_t next = 1;              // first tick not yet advanced over
+
+    static uint64_t rangeMask(uint64_t lo, uint64_t hi) {    // bits lo..hi
+        return (hi == Slots - 1 ? ~0ULL : (2ULL << hi) - 1) & (~0ULL << lo);
     }
-    void removeValueStructures(int x, Node* node) {
-        // locs
-        auto lit = locs.find(x);
-        if (lit != locs.end()) {
-            lit->second.erase(node);
-            if (lit->second.empty()) locs.erase(lit);
-        }
-        // freq/mode
-        modeDec(x);
-        // min/max
-        auto it = allVals.find(x);
-        if (it != allVals.end()) allVals.erase(it);
-        // median
-        medianRemove(x);
-        // random pool
-        poolRemove(node);
-        sz--;
+    static void push(WheelTimer &list, WheelTimer* t) {
+        t->prev = list.prev;
+        t->next = &list;
+        list.prev->next = t;
+        list.prev = t;
+    }
+    // Detach the whole list into a local sentinel and hand it to f
+    template<class F>
+    static size_t drainList(WheelTimer &list, F &&f) {
+        if (list.next == &list) return 0;
+        WheelTimer local;
+        local.next = list.next;
+        local.prev = list.prev;
+        local.next->prev = local.prev->next = &local;
+        list.prev = list.next = &list;
+        size_t n = 0;
+        while (local.next != &local) {
+            WheelTimer* t = local.next;
+            cancel(t);
+            f(t);
+            n++;
+        }
+        return n;
+    }
+    template<class F>
+    static size_t fireList(WheelTimer &list, F &fire) { return drainList(list, fire); }
+    void refile(WheelTimer &list) { drainList(list, [&](WheelTimer* t) { file(t); }); }
+    // the clock may have been ahead of the caller's time: keep what is not yet due
+    template<class F>
+    size_t fireDue(uint64_t t, F &fire) {
+        WheelTimer later;
+        later.prev = later.next = &later;
+        size_t n = 0;
+        drainList(due, [&](WheelTimer* x) {
+            if (x->deadline > t) { push(later, x); return; }
+            fire(x);
+            n++;
+        });
+        while (later.next != &later) {
+            WheelTimer* x = later.next;
+            cancel(x);
+            push(due, x);
+        }
+        return n;
     }
 
-    // Rebuild all auxiliary structures from the current linked list
-    void rebuildAll() {
-        locs.clear();
-        freq.clear();
-        allVals.clear();
-        lower.clear();
-        upper.clear();
-        pool.clear();
-        poolPos.clear();
-        modeCnt = 0;
-        modeVal = 0;
-        // traverse and add
-        for (Node* cur = head; cur; cur = cur->next) {
-            addValueStructures(cur->val, cur);
+    void file(WheelTimer* t) {
+        if (t->deadline < next) { push(due, t); return; }
+        uint64_t diff = t->deadline ^ next;
+        int level = diff ? (63 - __builtin_clzll(diff)) / SlotBits : 0;
+        if (level >= Levels) { push(overflow, t); return; }
+        uint64_t s = (t->deadline >> (level * SlotBits)) & (Slots - 1);
+        push(slot[level][s], t);
+        occupied[level] |= 1ULL << s;
+    }
+    // next has just reached a multiple of 64: pull down the coarse slots it enters
+    void cascade() {
+        for (int l = 1; l < Levels; l++) {
+            if (next & ((1ULL << (l * SlotBits)) - 1)) return;
+            uint64_t s = (next >> (l * SlotBits)) & (Slots - 1);
+            occupied[l] &= ~(1ULL << s);
+            refile(slot[l][s]);
+        }
+        if (!(next & ((1ULL << (Levels * SlotBits)) - 1))) refile(overflow);
+    }
+    // Start of the earliest occupied slot above level 0 (or of the next top-level
+    // wrap if only the overflow list is pending); UINT64_MAX when nothing is armed
+    uint64_t nextOccupied() const {
+        for (int l = 1; l < Levels; l++) {
+            uint64_t d = (next >> (l * SlotBits)) & (Slots - 1);
+            uint64_t m = d == Slots - 1 ? 0 : occupied[l] & (~0ULL << (d + 1));
+            if (m) {
+                int shift = (l + 1) * SlotBits;
+                return (next >> shift << shift) | ((uint64_t)__builtin_ctzll(m) << (l * SlotBits));
+            }
         }
+        if (overflow.next == &overflow) return UINT64_MAX;
+        int top = Levels * SlotBits;
+        return ((next >> top) + 1) << top;
     }
+};
+
+// ----------------- Background reclaimer -----------------
+// One process-wide thread that frees storage containers have detached from
+// themselves, so dropping a huge container costs its owner O(1). A job frees
+// itself in installments through step(); afterwards the reclaimer hands its
+// SmallPool cache back to the heap (pool blocks may be freed on any thread).
+struct Reclaimable {
+    virtual ~Reclaimable() = default;
+    // free up to `budget` items; true when nothing is left
+    virtual bool step(size_t budget) = 0;
+};
 
+class BackgroundReclaimer {
 public:
-    ~AdvancedDS() {
-        clear();
+    // Never destroyed: containers with static storage may still post at exit. exit()
+    // waits for what was posted before it, so nothing is left half freed (and a leak
+    // checker finds nothing outstanding).
+    static BackgroundReclaimer& instance() {
+        static BackgroundReclaimer* r = [] {
+            auto* p = new BackgroundReclaimer;
+            atexit([] { instance().wait(); });
+            return p;
+        }();
+        return *r;
+    }
+    // Takes ownership of job
+    void post(Reclaimable* job) {
+        {
+            lock_guard<mutex> lk(m);
+            jobs.push_back(job);
+        }
+        wake.notify_one();
+    }
+    // Block until everything posted so far is freed
+    void wait() {
+        unique_lock<mutex> lk(m);
+        idle.wait(lk, [&] { return jobs.empty() && !busy; });
     }
 
-    // ---------- Basic info ----------
-    bool empty() const { return sz == 0; }
-    size_t size() const { return sz; }
+private:
+    static constexpr size_t Step = 4096;
+    mutex m;
+    condition_variable wake, idle;
+    deque<Reclaimable*> jobs;
+    bool busy = false;
 
-    // ---------- Push/Pop / Front/Back ----------
-    void pushBack(int x) {
-        Node* node = new Node(x);
-        attachBack(node);
-        addValueStructures(x, node);
+    BackgroundReclaimer() { thread([this] { run(); }).detach(); }
+    void run() {
+        unique_lock<mutex> lk(m);
+        for (;;) {
+            wake.wait(lk, [&] { return !jobs.empty(); });
+            Reclaimable* job = jobs.front();
+            jobs.pop_front();
+            busy = true;
+            lk.unlock();
+            while (!job->step(Step)) {}
+            delete job;
+            SmallPool::trim();
+            lk.lock();
+            busy = false;
+            if (jobs.empty()) idle.notify_all();
+        }
     }
-    void pushFront(int x) {
-        Node* node = new Node(x);
-        attachFront(node);
-        addValueStructures(x, node);
+};
+
+// ----------------- Epoch-based reclamation -----------------
+// Lets readers walk linked structures without a lock while writers unlink nodes
+// from them. A reader pins the global epoch for the length of its walk (Guard); a
+// writer retire()s what it unlinked instead of freeing it. A retired object is
+// tagged with the epoch current at retirement, and the epoch only advances once
+// every pinned reader has announced the current one, so two advances later no
+// reader can still hold it. Pinning is a store and a fence (nested guards are free);
+// retire takes a short lock and every CollectEvery retirements tries to free a batch.
+// Up to MaxReaders threads hold a reader slot at a time (kept until the thread exits);
+// further ones wait for a free slot.
+class EpochDomain {
+public:
+    class Guard {
+    public:
+        Guard() { instance().pin(); }
+        ~Guard() { instance().unpin(); }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // Never destroyed: retired objects may still be pending at exit
+    static EpochDomain& instance() {
+        static EpochDomain* d = new EpochDomain;
+        return *d;
     }
-    void popBack() {
-        if (!tail) return;
-        Node* node = tail;
-        int x = node->val;
-        detach(node);
-        removeValueStructures(x, node);
-        delete node;
+    // Call release(p) once no reader can reach p any more; p must already be unlinked
+    void retire(void* p, void (*release)(void*)) {
+        atomic_thread_fence(memory_order_seq_cst);     // the unlink precedes the tag
+        vector<Retired> ready;
+        {
+            lock_guard<mutex> lk(m);
+            limbo.push_back({p, release, global.load(memory_order_seq_cst)});
+            if (++sinceCollect < CollectEvery) return;
+            sinceCollect = 0;
+            takeReady(ready);
+        }
+        releaseAll(ready);
     }
-    void popFront() {
-        if (!head) return;
-        Node* node = head;
-        int x = node->val;
-        detach(node);
-        removeValueStructures(x, node);
-        delete node;
+    // Advance the epoch if the readers allow and release what became safe; returns the count
+    size_t collect() {
+        vector<Retired> ready;
+        {
+            lock_guard<mutex> lk(m);
+            takeReady(ready);
+        }
+        releaseAll(ready);
+        return ready.size();
+    }
+    // Retired objects not yet released
+    size_t pending() {
+        lock_guard<mutex> lk(m);
+        return limbo.size();
     }
-    int front() const { return head ? head->val : INT_MIN; }
-    int back()  const { return tail ? tail->val : INT_MIN; }
-    int top()   const { return back(); } // alias
 
-    // ---------- Search / Frequency ----------
-    bool contains(int x) const { return freq.count(x) > 0; }
-    int getFrequency(int x) const {
-        auto it = freq.find(x);
-        return (it == freq.end()) ? 0 : it->second;
+private:
+    static constexpr uint64_t Idle = 0;             // epochs start at 1
+    static constexpr size_t MaxReaders = 256, CollectEvery = 64;
+    struct alignas(64) Slot {
+        atomic<uint64_t> epoch{Idle};
+        atomic<bool> taken{false};
+    };
+    struct Retired {
+        void* p;
+        void (*release)(void*);
+        uint64_t epoch;
+    };
+    struct ThreadSlot {
+        Slot* slot = nullptr;
+        int depth = 0;
+        ~ThreadSlot() { if (slot) slot->taken.store(false, memory_order_release); }
+    };
+
+    Slot slots[MaxReaders];
+    atomic<size_t> used{0};                         // slots ever handed out
+    atomic<uint64_t> global{1};
+    mutex m;
+    deque<Retired> limbo;                           // epochs non-decreasing
+    size_t sinceCollect = 0;
+
+    EpochDomain() = default;
+    static ThreadSlot& threadSlot() {
+        thread_local ThreadSlot ts;
+        return ts;
+    }
+    Slot* claimSlot() {
+        for (;;) {
+            for (size_t i = 0; i < MaxReaders; i++) {
+                bool f = false;
+                if (!slots[i].taken.compare_exchange_strong(f, true, memory_order_acq_rel)) continue;
+                size_t u = used.load(memory_order_relaxed);
+                while (u < i + 1 && !used.compare_exchange_weak(u, i + 1, memory_order_seq_cst)) {}
+                return &slots[i];
+            }
+            this_thread::yield();
+        }
+    }
+    void pin() {
+        ThreadSlot &ts = threadSlot();
+        if (ts.depth++) return;
+        if (!ts.slot) ts.slot = claimSlot();
+        // An announcement that lands after an advance is one epoch behind, which
+        // only holds up the next advance: still safe.
+        ts.slot->epoch.store(global.load(memory_order_seq_cst), memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+    void unpin() {
+        ThreadSlot &ts = threadSlot();
+        if (--ts.depth == 0) ts.slot->epoch.store(Idle, memory_order_release);
+    }
+    bool tryAdvance() {     // under m
+        uint64_t g = global.load(memory_order_seq_cst);
+        for (size_t i = 0, n = used.load(memory_order_seq_cst); i < n; i++) {
+            uint64_t e = slots[i].epoch.load(memory_order_seq_cst);
+            if (e != Idle && e != g) return false;
+        }
+        global.store(g + 1, memory_order_seq_cst);
+        return true;
+    }
+    // Off any memory count: the owners wrote these off when they retired them
+    static void releaseAll(vector<Retired> &ready) {
+        ChargeTo uncounted(nullptr);
+        for (Retired &r : ready) r.release(r.p);
+    }
+    void takeReady(vector<Retired> &ready) {    // under m
+        for (int i = 0; i < 2 && tryAdvance(); i++) {}
+        uint64_t g = global.load(memory_order_relaxed);
+        while (!limbo.empty() && limbo.front().epoch + 2 <= g) {
+            ready.push_back(limbo.front());
+            limbo.pop_front();
+        }
+    }
+};
+
+// ----------------- Work-stealing deque -----------------
+// Chase-Lev deque (in the C11 formulation of Le et al.) for per-worker task queues.
+// The owning thread pushes and pops at the back: wait-free, apart from the array
+// doubling in pushBack. Any thread may stealFront: lock-free, one CAS on top; a
+// steal that loses a race returns false and the thief moves on. Outgrown arrays are
+// retired, not freed, because a thief may still be reading one; they go with the
+// deque. Items are trivially copyable (task ids, pointers); no statistics are kept.
+template<class T>
+class WorkStealingDeque {
+    static_assert(is_trivially_copyable<T>::value, "WorkStealingDeque holds trivially copyable types");
+    struct Array {
+        size_t mask;
+        unique_ptr<atomic<T>[]> slots;
+        explicit Array(size_t cap): mask(cap - 1), slots(new atomic<T>[cap]) {}
+        T get(int64_t i) const { return slots[i & mask].load(memory_order_relaxed); }
+        void put(int64_t i, T x) { slots[i & mask].store(x, memory_order_relaxed); }
+    };
+
+    alignas(64) atomic<int64_t> top{0};     // thieves' end
+    alignas(64) atomic<int64_t> bottom{0};  // owner's end
+    alignas(64) atomic<Array*> array;
+    vector<unique_ptr<Array>> arrays;       // owner only; the last one is current
+
+    Array* grow(Array* a, int64_t t, int64_t b) {
+        arrays.push_back(make_unique<Array>((a->mask + 1) * 2));
+        Array* bigger = arrays.back().get();
+        for (int64_t i = t; i < b; i++) bigger->put(i, a->get(i));
+        array.store(bigger, memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit WorkStealingDeque(size_t initialCap = 256) {
+        size_t cap = 1;
+        while (cap < initialCap) cap *= 2;
+        arrays.push_back(make_unique<Array>(cap));
+        array.store(arrays.back().get(), memory_order_relaxed);
+    }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void pushBack(T x) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        Array* a = array.load(memory_order_relaxed);
+        if (b - t > (int64_t)a->mask) a = grow(a, t, b);
+        a->put(b, x);
+        atomic_thread_fence(memory_order_release);
+        bottom.store(b + 1, memory_order_relaxed);
+    }
+    // Owner only; false when empty (or the last item was just stolen)
+    bool popBack(T &out) {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        Array* a = array.load(memory_order_relaxed);
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return false;
+        }
+        out = a->get(b);
+        if (t < b) return true;
+        // last item: race the thieves for it
+        bool won = top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+        bottom.store(b + 1, memory_order_relaxed);
+        return won;
+    }
+    // Any thread; false when empty or when another thread took the item first
+    bool stealFront(T &out) {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b) return false;
+        T x = array.load(memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) return false;
+        out = x;
+        return true;
+    }
+    // Racy snapshot
+    size_t size() const {
+        int64_t b = bottom.load(memory_order_relaxed), t = top.load(memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+    bool empty() const { return size() == 0; }
+};
+
+// ----------------- Change feed -----------------
+// Change-data-capture stream of a container's mutations, for mirrors that would
+// otherwise re-read it. One writer publishes (the container, under whatever serializes
+// its updates); any number of readers follow at their own pace, lock-free, each with
+// its own cursor, in batches. Each bulk operation is one event (a sort, a rotate, a
+// removeDuplicates), replayed by the mirror itself: see BasicAdvancedDS::applyChange.
+// The ring keeps the last `capacity` events; every slot is a small seqlock, so a
+// reader notices when the writer lapped it, and then gets a Resync event instead.
+enum class ChangeOp : uint16_t {
+    PushBack, PushFront, PushBackTtl, PopBack, PopFront, DeleteVal, Update, Expire,
+    RemoveDuplicates, Rotate, Reverse, SortAscending, SortDescending, PartialSort,
+    NthElement, NextPermutation, PrevPermutation, Clear,
+    Resync      // not replayable (merge, split, swap, sorts by a key...): reload a snapshot
+};
+struct ChangeEvent {
+    uint64_t seq;
+    ChangeOp op;
+    int x;          // the value pushed / deleted / updated from
+    uint64_t arg;   // ttl, k, expire time, or the new value of an Update
+};
+
+class ChangeFeed {
+public:
+    explicit ChangeFeed(size_t capacity = 1 << 16) {
+        size_t cap = 1;
+        while (cap < capacity) cap *= 2;
+        mask = cap - 1;
+        slots.reset(new Slot[cap]);
+    }
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    // Writer only
+    void publish(ChangeOp op, int x = 0, uint64_t arg = 0) {
+        uint64_t s = head.load(memory_order_relaxed);
+        Slot &sl = slots[s & mask];
+        sl.ver.store(2 * s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        sl.word.store((uint64_t)op | (uint64_t)(uint32_t)x << 32, memory_order_relaxed);
+        sl.arg.store(arg, memory_order_relaxed);
+        sl.ver.store(2 * s + 2, memory_order_release);
+        head.store(s + 1, memory_order_release);
+    }
+    // Cursor of the next event to be published: where a reader that has just taken a
+    // snapshot (under the writer's lock) starts
+    uint64_t end() const { return head.load(memory_order_acquire); }
+    // Copy up to max events from cursor on into out, moving cursor past them; returns
+    // how many. A batch stops after a Resync; a reader the writer has lapped gets a
+    // Resync (cursor jumps to the newest event) and should reload and restart at end().
+    size_t read(uint64_t &cursor, ChangeEvent* out, size_t max) const {
+        size_t n = 0;
+        uint64_t h = head.load(memory_order_acquire);
+        while (n < max && cursor < h) {
+            const Slot &sl = slots[cursor & mask];
+            uint64_t v = sl.ver.load(memory_order_acquire);
+            uint64_t w = sl.word.load(memory_order_relaxed), arg = sl.arg.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (v != 2 * cursor + 2 || sl.ver.load(memory_order_relaxed) != v) {
+                // the writer has (begun to) put event cursor + capacity there: lapped
+                out[n++] = {cursor, ChangeOp::Resync, 0, 0};
+                cursor = head.load(memory_order_acquire);
+                break;
+            }
+            ChangeEvent &e = out[n++];
+            e = {cursor++, (ChangeOp)(uint16_t)w, (int)(uint32_t)(w >> 32), arg};
+            if (e.op == ChangeOp::Resync) break;
+        }
+        return n;
+    }
+
+private:
+    struct Slot {
+        atomic<uint64_t> ver{0};    // 2*seq + 2 once event seq is in; odd while writing
+        atomic<uint64_t> word{0}, arg{0};
+    };
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) atomic<uint64_t> head{0};
+};
+
+/**
+ * AdvancedDS: a feature-rich container
+ * Core structure: Doubly Linked List (order), plus auxiliary indices.
+ * Rng is the engine behind getRandom (Xoshiro256ss, Pcg32, ThreadLocalRng, or any std engine).
+ * Nodes and index entries come from SmallPool, so steady-state push/pop cycles do not
+ * touch the global allocator once warmed up. Nothing grows by stop-the-world copying:
+ * the value index rehashes incrementally and the random pool is a ChunkedVector.
+ *
+ * Operations (typical cost):
+ *  - pushBack / pushFront / popBack / popFront / front / back / top : O(1) (+ O(log n) value indices)
+ *  - search / contains / getFrequency / size / empty : O(1) average, no rehash pauses
+ *  - deleteVal(x) / update(old->new) : O(1) avg for locating + O(log n) to fix min/max/median/mode
+ *  - getMin / getMax : O(1) (multiset begin/rbegin)
+ *  - getMedian : O(1) (two multisets; rebalancing relinks nodes, no allocation)
+ *  - getMode : O(1)
+ *  - kthSmallest(k) / quantile(q) : O(distance from k to the min, median or max) ;
+ *    countBetween / kthBetween(lo, hi, ..) : O(log n + values walked)
+ *  - subscribe(fields, fn) / subscribeCrossing : O(1) extra per update while anyone listens;
+ *    callbacks run once per operation or batch, only when a watched statistic changed
+ *  - attachChangeFeed(feed) : O(1) per update, one event per operation (a sort is one);
+ *    mirrors replay it with applyChange, seeded by assignFrom : O(n log n)
+ *  - forEach(visit) : O(n), list order
+ *  - setMemoryBudget(bytes, policy) : memoryUsed() (counted by the allocators) capped
+ *    after each update by evicting oldest / least frequent / random elements in batches
+ *  - saveSnapshot : O(n) ; loadSnapshot : O(n log n), the image Replica processes start from
+ *  - containsMany / getFrequencyMany(keys) : O(1) per key, lookups grouped and prefetched
+ *  - getRandom : O(1) ; seeded differently each run unless constructed with a seed
+ *    or reseeded with seed(s)
+ *  - pushBack(x, ttl) : O(log n) + O(1) timer ; expire(now) : O(expired), hierarchical timing wheel
+ *  - pushAndSummarize(x, cap) : pushBack + evict to cap + chosen statistics in one call
+ *  - getKth(k) : O(distance) from the nearest of head, tail and the previous getKth
+ *  - traverse / reverse / rotate(k) : O(n)
+ *  - sortAscending / sortDescending / stableSortBy(key) : O(n log n), relinks nodes (no rebuild)
+ *  - stablePartition(pred) : O(n), relinks nodes
+ *  - partialSortAscending(k) : O(k) ; nthElement(k) : O(min(k, n-k)) (relink via the value index)
+ *  - nextPermutation / prevPermutation : amortized O(1) per step (relinks the changed suffix only)
+ *  - uniqueElements / removeDuplicates : O(n)
+ *  - intersectCounts / unionCounts / difference(other) : O(distinct) on the frequency indices
+ *  - merge / split : O(smaller side), indices moved node by node (no rebuild)
+ *
+ * RealTime = true (RealTimeAdvancedDS) bounds every update by its own work, with no
+ * amortized pauses:
+ *  - push / pop / deleteVal / update / pushAndSummarize : O(log n) worst case
+ *    (mode is read from an ordered (count, value) index instead of rescanning on decrement)
+ *  - clear() : O(1); the old nodes and indices are freed ReclaimStep items per later
+ *    update, or at once with reclaim()
+ *  - merge / split : O(smaller side log n) ; sorts O(n log n) ; traverse / getKth /
+ *    rotate / reverse / removeDuplicates as above
+ *  - the destructor : O(1), its storage goes to BackgroundReclaimer as with deferred
+ *    reclaim
+ * Large arrays come from pageAlloc, never malloc. For a flat tail also lift the
+ * thread's SmallPool::setCacheLimit, so freed nodes stay cached instead of going
+ * back to malloc, whose free lists may stall to consolidate.
+ * The bound is paid for on every update: the mode index and the reclaim installments
+ * make a typical one about twice as slow as in the default mode, p99 included. What
+ * goes is the default mode's worst case (clear(), mode rescans), tens of ms at 10^5
+ * elements; p99.99 sits between the two and, on a shared core, is set by preemption.
+ *
+ * setDeferredReclaim(true) (either mode): clear(), the destructor and move-assignment
+ * detach the storage in O(1) and BackgroundReclaimer frees it on its own thread.
+ *
+ * setSharedReaders(true): walkShared may run on other threads, lock-free, while the
+ * (still serialized) updates go on; removed nodes are freed through EpochDomain.
+ */
+
+template<class Rng = Xoshiro256ss, bool RealTime = false>
+class BasicAdvancedDS {
+    struct NodeTimer;
+    struct Node {
+        int val;
+        uint32_t poolIdx = 0;                      // slot in pool (packed beside val, hence MaxSize)
+        Node *prev, *next;
+        Node *vprev = nullptr, *vnext = nullptr;   // other nodes with the same value
+        NodeTimer* timer = nullptr;                // expiry, if pushed with a ttl
+        Node(int v): val(v), prev(nullptr), next(nullptr) {}
+        ~Node() { delete timer; }
+
+        static void* operator new(size_t n) { return SmallPool::allocate(n); }
+        static void operator delete(void* p, size_t n) { SmallPool::deallocate(p, n); }
+    };
+    struct NodeTimer : WheelTimer {
+        Node* node;
+        explicit NodeTimer(Node* n): node(n) {}
+
+        static void* operator new(size_t n) { return SmallPool::allocate(n); }
+        static void operator delete(void* p, size_t n) { SmallPool::deallocate(p, n); }
+    };
+
+    // Doubly-linked list to maintain order
+    Node *head = nullptr, *tail = nullptr;
+    size_t sz = 0;
+
+    // Expiry of nodes pushed with a ttl; created on first use (the wheel is ~6KB)
+    unique_ptr<TimingWheel> wheel;
+    uint64_t ttlNow = 0;        // time last passed to expire()
+
+    // Finger: the node getKth last returned and its position. Pushes and pops at
+    // the ends keep it in step; any other relink drops it. A cache, so getKth stays const.
+    mutable Node* finger = nullptr;
+    mutable size_t fingerPos = 0;
+
+    // Shared readers (walkShared): list links they follow are published with release
+    // stores, and relinks other than at the ends bump relinkSeq, odd while under way
+    bool shared = false;
+    int relinkDepth = 0;
+    atomic<uint64_t> relinkSeq{0};
+
+    // Change feed (attachChangeFeed): each mutation is published to it, not owned
+    ChangeFeed* feed = nullptr;
+
+    // Value -> frequency + its nodes (intrusive list through vprev/vnext:
+    // duplicates supported, O(1) erase by pointer)
+    struct ValInfo {
+        int cnt = 0;
+        Node* first = nullptr;
+    };
+    IncrementalHashMap<int, ValInfo> vals;
+
+    // Mode tracking. RealTime keeps every (-count, value) in an ordered index whose
+    // first element is the mode; otherwise a decrement of the mode rescans vals.
+    int modeVal = 0;
+    int modeCnt = 0;
+    struct NoIndex {};
+    using ModeIndex = set<pair<int,int>, less<pair<int,int>>, PoolAlloc<pair<int,int>>>;
+    [[no_unique_address]] conditional_t<RealTime, ModeIndex, NoIndex> modeIdx;
+    bool deferMode = false, modeStale = false;   // bulk moves rescan once at the end
+
+    // Min/Max (all values)
+    PoolMultiset allVals;
+
+    // Median maintenance: lower = max half, upper = min half
+    PoolMultiset lower, upper; // invariants: |lower| >= |upper| and |lower|-|upper|<=1
+
+    // Random support: pool of node pointers, each node knows its slot (swap-remove)
+    ChunkedVector<Node*> pool;
+    [[no_unique_address]] Rng rng;
+
+    // Storage detached by clear(): RealTime frees it a few items per update,
+    // deferred reclaim posts it to the background reclaimer
+    static constexpr size_t ReclaimStep = 32;
+    struct Graveyard final : Reclaimable {
+        Node* nodes = nullptr;      // chain through next
+        IncrementalHashMap<int, ValInfo> vals;
+        PoolMultiset allVals, lower, upper;
+        ModeIndex modeIdx;
+        ChunkedVector<Node*> pool;
+        Graveyard* older = nullptr;
+        int64_t bytes = 0;          // what clear() left here, down to 0 once freed
+
+        bool step(size_t budget) override {
+            ChargeTo charge(&bytes);
+            for (; budget > 0 && nodes; budget--) { Node* nxt = nodes->next; delete nodes; nodes = nxt; }
+            for (PoolMultiset* ms : {&allVals, &lower, &upper})
+                for (; budget > 0 && !ms->empty(); budget--) ms->erase(ms->begin());
+            for (; budget > 0 && !modeIdx.empty(); budget--) modeIdx.erase(modeIdx.begin());
+            if (!vals.drain(budget)) return false;
+            return !nodes && allVals.empty() && lower.empty() && upper.empty() && modeIdx.empty()
+                && pool.drain(budget);
+        }
+    };
+    Graveyard* graves = nullptr;    // newest first
+    bool deferred = false;          // hand detached storage to BackgroundReclaimer
+
+    // free up to `budget` graveyard items, oldest graveyard first
+    void reclaimStep(size_t budget) {
+        while (graves) {
+            Graveyard** pg = &graves;
+            while ((*pg)->older) pg = &(*pg)->older;
+            if (!(*pg)->step(budget)) return;
+            delete *pg;
+            *pg = nullptr;
+            if (budget != SIZE_MAX) return;
+        }
+    }
+    void postGraves() {
+        while (Graveyard* g = graves) {
+            graves = g->older;
+            g->older = nullptr;
+            BackgroundReclaimer::instance().post(g);
+        }
+    }
+
+    // ---- Helpers ----
+    // A release store is as cheap as a plain one on x86
+    static void publish(Node* &slot, Node* v) { __atomic_store_n(&slot, v, __ATOMIC_RELEASE); }
+    static Node* observe(Node* const &slot) { return __atomic_load_n(&slot, __ATOMIC_ACQUIRE); }
+    void relinkBegin() {
+        if (shared && relinkDepth++ == 0) {
+            relinkSeq.store(relinkSeq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+        }
+    }
+    void relinkEnd() {
+        if (shared && --relinkDepth == 0)
+            relinkSeq.store(relinkSeq.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+    // Nodes moved between two containers take their readers along: if either has
+    // shared readers, both retire removed nodes from then on
+    void shareReaders(BasicAdvancedDS &other) { shared = other.shared = shared || other.shared; }
+    // Removed nodes: shared readers may still stand on one
+    void dispose(Node* node) {
+        if (!shared) { delete node; return; }
+        memBytes -= SmallPool::blockBytes(sizeof(Node));   // freed uncounted, later
+        EpochDomain::instance().retire(node, [](void* p) { delete static_cast<Node*>(p); });
+    }
+    void record(ChangeOp op, int x = 0, uint64_t arg = 0) {
+        if (feed) feed->publish(op, x, arg);
+    }
+
+    void attachBack(Node* node) {
+        publish(node->next, nullptr);
+        node->prev = tail;
+        publish(tail ? tail->next : head, node);
+        tail = node;
+    }
+    void attachFront(Node* node) {
+        if (finger) fingerPos++;
+        node->prev = nullptr;
+        publish(node->next, head);
+        if (head) head->prev = node; else tail = node;
+        publish(head, node);
+    }
+    // Room for `more` elements, or length_error before anything changed
+    void reserveRoom(size_t more) const {
+        if (more > MaxSize - sz) throw length_error("BasicAdvancedDS: over MaxSize elements");
+    }
+    Node* append(int x) {
+        reserveRoom(1);
+        Node* node = new Node(x);
+        attachBack(node);
+        addValueStructures(x, node);
+        return node;
+    }
+    // Take the node out of the list for good: its expiry goes too
+    void detach(Node* node) {
+        if (node->timer) disarm(node);
+        unlink(node);
+    }
+    // Take the node out of the list to be relinked elsewhere. The node keeps its own
+    // links: a shared reader standing on it walks on to its old successor
+    void unlink(Node* node) {
+        if (node == finger || (node != head && node != tail)) finger = nullptr;
+        else if (finger && node == head) fingerPos--;
+        publish(node->prev ? node->prev->next : head, node->next);
+        if (node->next) node->next->prev = node->prev; else tail = node->prev;
+    }
+    // make b follow a (either may be null at the list ends)
+    void link(Node* a, Node* b) {
+        finger = nullptr;
+        relinkBegin();
+        publish(a ? a->next : head, b);
+        if (b) b->prev = a; else tail = a;
+        relinkEnd();
+    }
+    // Exchange the list positions of a and b; nodes keep their values
+    void swapNodes(Node* a, Node* b) {
+        if (a == b) return;
+        if (b->next == a) std::swap(a, b);
+        if (a->next == b) {
+            Node *ap = a->prev, *bn = b->next;
+            link(ap, b); link(b, a); link(a, bn);
+        } else {
+            Node *ap = a->prev, *an = a->next, *bp = b->prev, *bn = b->next;
+            link(ap, b); link(b, an); link(bp, a); link(a, bn);
+        }
+    }
+    void insertAfter(Node* pos, Node* node) {   // pos == nullptr: at the front
+        if (!pos) { attachFront(node); return; }
+        Node* nx = pos->next;
+        link(pos, node); link(node, nx);
+    }
+    void insertBefore(Node* pos, Node* node) {  // pos == nullptr: at the back
+        if (!pos) { attachBack(node); return; }
+        Node* pv = pos->prev;
+        link(pv, node); link(node, pos);
+    }
+    // Reverse the run first..tail in place by relinking
+    void reverseFrom(Node* first) {
+        finger = nullptr;
+        relinkBegin();
+        Node* before = first->prev;
+        Node* oldTail = tail;
+        for (Node* cur = first; cur; ) {
+            Node* nxt = cur->next;
+            publish(cur->next, cur->prev);
+            cur->prev = nxt;
+            cur = nxt;
+        }
+        publish(first->next, nullptr);
+        tail = first;
+        oldTail->prev = before;
+        publish(before ? before->next : head, oldTail);
+        relinkEnd();
+    }
+
+    void arm(Node* node, uint64_t deadline) {
+        if (!wheel) wheel = make_unique<TimingWheel>(ttlNow);
+        if (!node->timer) node->timer = new NodeTimer(node);
+        wheel->schedule(node->timer, deadline);
+    }
+    void disarm(Node* node) {
+        TimingWheel::cancel(node->timer);
+        delete node->timer;
+        node->timer = nullptr;
+    }
+
+    void poolAdd(Node* node) {
+        node->poolIdx = (uint32_t)pool.size();
+        pool.push_back(node);
+    }
+    void poolRemove(Node* node) {
+        Node* last = pool.back();
+        pool[node->poolIdx] = last;
+        last->poolIdx = node->poolIdx;
+        pool.pop_back();
+    }
+
+    // x now occurs f times
+    void modeInc(int x, int f) {
+        if constexpr (RealTime) {
+            if (f == 1) modeIdx.emplace(-1, x);
+            else {
+                auto nh = modeIdx.extract({-(f - 1), x});
+                nh.value().first = -f;
+                modeIdx.insert(std::move(nh));
+            }
+            modeFromIndex();
+        } else if (f > modeCnt || (f == modeCnt && x < modeVal)) {
+            modeCnt = f;
+            modeVal = x;
+        }
+    }
+    void modeDec(int x, int f) {
+        if constexpr (RealTime) {
+            auto nh = modeIdx.extract({-(f + 1), x});
+            if (f > 0) {
+                nh.value().first = -f;
+                modeIdx.insert(std::move(nh));
+            }
+            modeFromIndex();
+        } else if (x == modeVal && f < modeCnt) {
+            // Recompute mode if needed (rare path)
+            if (deferMode) modeStale = true;
+            else recomputeMode();
+        }
+    }
+    void modeFromIndex() {
+        if constexpr (RealTime) {
+            if (modeIdx.empty()) { modeCnt = 0; modeVal = 0; }
+            else { modeCnt = -modeIdx.begin()->first; modeVal = modeIdx.begin()->second; }
+        }
+    }
+    void recomputeMode() {
+        modeCnt = 0;
+        vals.forEach([&](int v, const ValInfo &vi) {
+            if (vi.cnt > modeCnt || (vi.cnt == modeCnt && v < modeVal)) {
+                modeCnt = vi.cnt;
+                modeVal = v;
+            }
+        });
+    }
+    // Bracket bulk node moves: a stale mode is rescanned once instead of per node
+    void beginBulk() { deferMode = true; }
+    void endBulk() {
+        deferMode = false;
+        if (modeStale) { modeStale = false; recomputeMode(); }
+    }
+
+    void medianAdd(int x) {
+        if (lower.empty() || x <= *lower.rbegin()) lower.insert(x);
+        else upper.insert(x);
+        rebalanceMedian();
+    }
+    void medianRemove(int x) {
+        // erase one instance from the correct multiset
+        if (!lower.empty() && x <= *lower.rbegin()) {
+            auto it = lower.find(x);
+            if (it != lower.end()) lower.erase(it);
+            else {
+                auto iu = upper.find(x);
+                if (iu != upper.end()) upper.erase(iu);
+            }
+        } else {
+            auto iu = upper.find(x);
+            if (iu != upper.end()) upper.erase(iu);
+            else {
+                auto il = lower.find(x);
+                if (il != lower.end()) lower.erase(il);
+            }
+        }
+        rebalanceMedian();
+    }
+    // Moves the boundary element across by relinking its tree node (extract + hinted
+    // insert at the near end), so rebalancing never frees or allocates.
+    void rebalanceMedian() {
+        if (lower.size() > upper.size() + 1) {
+            upper.insert(upper.begin(), lower.extract(prev(lower.end())));
+        } else if (upper.size() > lower.size()) {
+            lower.insert(lower.end(), upper.extract(upper.begin()));
+        }
+    }
+
+    void addValueStructures(int x, Node* node) {
+        if constexpr (RealTime) if (graves) reclaimStep(ReclaimStep);
+        if (watch) touch();
+        ValInfo &vi = vals[x];
+        node->vprev = nullptr;
+        node->vnext = vi.first;
+        if (vi.first) vi.first->vprev = node;
+        vi.first = node;
+        modeInc(x, ++vi.cnt);
+        allVals.insert(x);
+        medianAdd(x);
+        poolAdd(node);
+        sz++;
+    }
+    void removeValueStructures(int x, Node* node) {
+        if constexpr (RealTime) if (graves) reclaimStep(ReclaimStep);
+        if (watch) touch();
+        // value list + frequency
+        ValInfo &vi = *vals.find(x);
+        if (node->vprev) node->vprev->vnext = node->vnext; else vi.first = node->vnext;
+        if (node->vnext) node->vnext->vprev = node->vprev;
+        node->vprev = node->vnext = nullptr;
+        int f = --vi.cnt;
+        if (f == 0) vals.erase(x);
+        // mode
+        modeDec(x, f);
+        // min/max
+        auto it = allVals.find(x);
+        if (it != allVals.end()) allVals.erase(it);
+        // median
+        medianRemove(x);
+        // random pool
+        poolRemove(node);
+        sz--;
+    }
+
+    // Relink the nodes holding the next k values of allVals, read from `it`, into a
+    // sorted run at the front (ascending iterator) or at the back (descending
+    // iterator). Nodes are found through vals; nothing else moves, no index changes.
+    template<bool Front, class It>
+    void gatherSorted(It it, size_t k) {
+        Node* edge = nullptr;   // last node placed
+        while (k > 0) {
+            const ValInfo &vi = *vals.find(*it);
+            size_t take = min((size_t)vi.cnt, k);
+            Node* nxtSame = vi.first;
+            for (size_t t = 0; t < take; t++, ++it) {
+                Node* node = nxtSame;
+                nxtSame = node->vnext;
+                if (node != (Front ? (edge ? edge->next : head) : (edge ? edge->prev : tail))) {
+                    unlink(node);
+                    if (Front) insertAfter(edge, node); else insertBefore(edge, node);
+                }
+                edge = node;
+            }
+            k -= take;
+        }
+    }
+
+    // Stable merge of two null-terminated runs (next links only); a precedes b
+    template<class Less>
+    static Node* mergeRuns(Node* a, Node* b, Less& less) {
+        Node* out = nullptr;
+        Node** t = &out;
+        while (a && b) {
+            if (less(b->val, a->val)) { publish(*t, b); b = b->next; }
+            else { publish(*t, a); a = a->next; }
+            t = &(*t)->next;
+        }
+        publish(*t, a ? a : b);
+        return out;
+    }
+    // Bottom-up stable merge sort that relinks nodes: values stay in their nodes,
+    // so no index is touched. O(n log n) compares, O(1) extra space.
+    template<class Less>
+    void mergeSortNodes(Less less) {
+        if (sz <= 1) return;
+        finger = nullptr;
+        relinkBegin();
+        Node* bins[64] = {};    // bins[i]: sorted run of 2^i nodes, earlier than lower bins
+        for (Node* cur = head; cur; ) {
+            Node* nxt = cur->next;
+            publish(cur->next, nullptr);
+            Node* carry = cur;
+            int i = 0;
+            for (; bins[i]; i++) { carry = mergeRuns(bins[i], carry, less); bins[i] = nullptr; }
+            bins[i] = carry;
+            cur = nxt;
+        }
+        Node* res = nullptr;
+        for (Node* b : bins) if (b) res = res ? mergeRuns(b, res, less) : b;
+        // restore back links
+        publish(head, res);
+        Node* p = nullptr;
+        for (Node* cur = head; cur; cur = cur->next) { cur->prev = p; p = cur; }
+        tail = p;
+        relinkEnd();
+    }
+
+    // Move the node at our front/back to dst's front/back, carrying its index
+    // entries across. O(log n).
+    // A pending expiry moves along (same deadline on dst's clock), and so do the
+    // node's bytes.
+    void moveNodeTo(Node* node, BasicAdvancedDS &dst, bool toFront) {
+        bool timed = node->timer;
+        uint64_t deadline = timed ? node->timer->deadline : 0;
+        {
+            ChargeTo charge(&memBytes);
+            detach(node);
+            removeValueStructures(node->val, node);
+        }
+        int64_t nodeBytes = SmallPool::blockBytes(sizeof(Node));
+        memBytes -= nodeBytes;
+        dst.memBytes += nodeBytes;
+        ChargeTo charge(&dst.memBytes);
+        if (toFront) dst.attachFront(node); else dst.attachBack(node);
+        dst.addValueStructures(node->val, node);
+        if (timed) dst.arm(node, deadline);
+    }
+    // swap everything but the random engine, the reclaim and budget settings and the
+    // expiry clock
+    void swapContents(BasicAdvancedDS &other) {
+        swap(other);
+        std::swap(rng, other.rng);
+        std::swap(deferred, other.deferred);
+        std::swap(memBudget, other.memBudget);
+        std::swap(evictPolicy, other.evictPolicy);
+        std::swap(ttlNow, other.ttlNow);
+    }
+
+public:
+    BasicAdvancedDS() = default;
+    // getRandom reproducible from the start (same as seed(s) right after construction)
+    explicit BasicAdvancedDS(uint64_t s) { seed(s); }
+    BasicAdvancedDS(BasicAdvancedDS &&other) noexcept { swap(other); }
+    BasicAdvancedDS& operator=(BasicAdvancedDS &&other) noexcept {
+        if (this != &other) { clear(); swap(other); }
+        return *this;
+    }
+    ~BasicAdvancedDS() {
+        watch.reset();
+        feed = nullptr;             // going away is not a change to replay
+        clear();
+        if (RealTime || deferred) postGraves();
+        reclaim();
+        // release what is no longer reachable now rather than at some later retire:
+        // retired graveyards hold mmapped tables, which leak checkers do not scan
+        if (shared) EpochDomain::instance().collect();
+    }
+
+    void swap(BasicAdvancedDS &other) noexcept {
+        shareReaders(other);
+        relinkBegin(); other.relinkBegin();
+        Node* h = head;
+        publish(head, other.head);
+        publish(other.head, h);
+        std::swap(finger, other.finger);
+        std::swap(fingerPos, other.fingerPos);
+        std::swap(tail, other.tail);
+        std::swap(sz, other.sz);
+        vals.swap(other.vals);
+        std::swap(modeVal, other.modeVal);
+        std::swap(modeCnt, other.modeCnt);
+        allVals.swap(other.allVals);
+        lower.swap(other.lower);
+        upper.swap(other.upper);
+        pool.swap(other.pool);
+        std::swap(rng, other.rng);
+        if constexpr (RealTime) modeIdx.swap(other.modeIdx);
+        std::swap(graves, other.graves);
+        std::swap(deferred, other.deferred);
+        wheel.swap(other.wheel);
+        std::swap(ttlNow, other.ttlNow);
+        std::swap(memBytes, other.memBytes);
+        std::swap(memBudget, other.memBudget);
+        std::swap(evictPolicy, other.evictPolicy);
+        other.relinkEnd(); relinkEnd();
+        record(ChangeOp::Resync); other.record(ChangeOp::Resync);
+    }
+
+    // ---------- Basic info ----------
+    // Most elements held; a push or merge past it throws length_error
+    static constexpr size_t MaxSize = UINT32_MAX;
+    bool empty() const { return sz == 0; }
+    size_t size() const { return sz; }
+
+    // ---------- Push/Pop / Front/Back ----------
+    void pushBack(int x) {
+        UpdateScope ns(*this);
+        append(x);
+        record(ChangeOp::PushBack, x);
+    }
+    void pushFront(int x) {
+        reserveRoom(1);
+        UpdateScope ns(*this);
+        Node* node = new Node(x);
+        attachFront(node);
+        addValueStructures(x, node);
+        record(ChangeOp::PushFront, x);
+    }
+    void popBack() {
+        if (!tail) return;
+        UpdateScope ns(*this);
+        Node* node = tail;
+        int x = node->val;
+        detach(node);
+        removeValueStructures(x, node);
+        dispose(node);
+        record(ChangeOp::PopBack);
+    }
+    void popFront() {
+        if (!head) return;
+        UpdateScope ns(*this);
+        Node* node = head;
+        int x = node->val;
+        detach(node);
+        removeValueStructures(x, node);
+        dispose(node);
+        record(ChangeOp::PopFront);
+    }
+    // ---------- Expiry ----------
+    // Time is whatever integer clock the caller feeds expire(). pushBack(x, ttl) makes
+    // x due at now + ttl, now being the time last passed to expire() (0 before that).
+    void pushBack(int x, uint64_t ttl) {
+        UpdateScope ns(*this);
+        arm(append(x), ttlNow + ttl);
+        record(ChangeOp::PushBackTtl, x, ttl);
+    }
+    // Remove every element due by now from the list and all indices, in one batch.
+    // O(expired + occupied wheel slots passed); untimed elements are never looked at.
+    // Returns the number removed.
+    size_t expire(uint64_t now) {
+        ttlNow = max(ttlNow, now);
+        record(ChangeOp::Expire, 0, now);
+        if (!wheel) return 0;
+        UpdateScope ns(*this);
+        return wheel->advance(now, [&](WheelTimer* t) {
+            Node* node = static_cast<NodeTimer*>(t)->node;
+            detach(node);
+            removeValueStructures(node->val, node);
+            dispose(node);
+        });
+    }
+
+    int front() const { return head ? head->val : INT_MIN; }
+    int back()  const { return tail ? tail->val : INT_MIN; }
+    int top()   const { return back(); } // alias
+
+    // ---------- Search / Frequency ----------
+    bool contains(int x) const { return vals.count(x); }
+    int getFrequency(int x) const {
+        const ValInfo* vi = vals.find(x);
+        return vi ? vi->cnt : 0;
+    }
+    // Batched forms: out[i] answers keys[i]. The probes' cache misses overlap,
+    // which helps once the value index no longer fits in cache.
+    void containsMany(const int* keys, size_t n, bool* out) const {
+        vals.findMany(keys, n, [&](size_t i, const ValInfo* vi) { out[i] = vi != nullptr; });
+    }
+    void getFrequencyMany(const int* keys, size_t n, int* out) const {
+        vals.findMany(keys, n, [&](size_t i, const ValInfo* vi) { out[i] = vi ? vi->cnt : 0; });
+    }
+#ifdef __cpp_lib_span
+    // out must hold at least keys.size() elements, as for the pointer forms (asserted)
+    void containsMany(span<const int> keys, span<bool> out) const {
+        assert(out.size() >= keys.size());
+        containsMany(keys.data(), keys.size(), out.data());
+    }
+    void getFrequencyMany(span<const int> keys, span<int> out) const {
+        assert(out.size() >= keys.size());
+        getFrequencyMany(keys.data(), keys.size(), out.data());
+    }
+#endif
+
+    // ---------- Min/Max/Median/Mode ----------
+    int getMin() const { return allVals.empty() ? INT_MAX : *allVals.begin(); }
+    int getMax() const { return allVals.empty() ? INT_MIN : *allVals.rbegin(); }
+    double getMedian() const {
+        if (sz == 0) return numeric_limits<double>::quiet_NaN();
+        if (lower.size() > upper.size()) return *lower.rbegin();
+        return ( (double)*lower.rbegin() + (double)*upper.begin() ) / 2.0;
+        // If you prefer integer median when even, return *lower.rbegin()
+    }
+    int getMode() const {
+        return (modeCnt == 0) ? INT_MIN : modeVal;
+    }
+
+    // ---------- Order statistics ----------
+    // The kth smallest value (0-indexed); false when k >= size. O(distance from k to the
+    // nearest of min, median and max), walking the median halves.
+    bool kthSmallest(size_t k, int &out) const {
+        if (k >= sz) return false;
+        bool low = k < lower.size();
+        const PoolMultiset &half = low ? lower : upper;
+        size_t i = low ? k : k - lower.size();
+        out = i <= half.size() / 2 ? *next(half.begin(), i) : *prev(half.end(), half.size() - i);
+        return true;
+    }
+    // The value of rank quantileRank(q, size); NaN when empty
+    double quantile(double q) const {
+        int v;
+        return kthSmallest(quantileRank(q, sz), v) ? v : numeric_limits<double>::quiet_NaN();
+    }
+    // floor(q * (n - 1)), q clamped to [0, 1]: 0 is the min, 0.5 the lower median, 1 the max
+    static size_t quantileRank(double q, size_t n) {
+        return n ? (size_t)(clamp(q, 0.0, 1.0) * (double)(n - 1)) : 0;
+    }
+    // How many values lie in [lo, hi]. O(log n + that many)
+    size_t countBetween(int lo, int hi) const {
+        if (lo > hi) return 0;
+        size_t n = 0;
+        for (auto it = allVals.lower_bound(lo); it != allVals.end() && *it <= hi; ++it) n++;
+        return n;
+    }
+    // The kth smallest (0-indexed) of the values in [lo, hi]; false when fewer. O(log n + k)
+    bool kthBetween(int lo, int hi, size_t k, int &out) const {
+        if (lo > hi) return false;
+        auto it = allVals.lower_bound(lo);
+        for (; it != allVals.end() && k; ++it) k--;
+        if (it == allVals.end() || *it > hi) return false;
+        out = *it;
+        return true;
+    }
+
+    // ---------- Streaming summary ----------
+    enum SummaryField : unsigned { SumMin = 1, SumMax = 2, SumMedian = 4, SumMode = 8, SumAll = 15 };
+    struct Summary {
+        size_t size = 0;
+        int min = INT_MAX, max = INT_MIN, mode = INT_MIN;
+        double median = numeric_limits<double>::quiet_NaN();
+    };
+    // pushBack(x), popFront() down to capacity, then read the statistics selected by
+    // Fields (others keep their empty-container defaults). When already at capacity the
+    // evicted head node is reused for x, so the step does no list allocation (not with
+    // shared readers, one of which may stand on that node).
+    template<unsigned Fields = SumAll>
+    Summary pushAndSummarize(int x, size_t capacity = SIZE_MAX) {
+        if (capacity == 0) { clear(); return Summary{}; }
+        UpdateScope ns(*this);
+        size_t keep = shared ? capacity - 1 : capacity;
+        while (sz > keep) popFront();
+        if (sz == capacity) {
+            Node* node = head;
+            detach(node);
+            removeValueStructures(node->val, node);
+            node->val = x;
+            attachBack(node);
+            addValueStructures(x, node);
+            record(ChangeOp::PopFront);
+            record(ChangeOp::PushBack, x);
+        } else {
+            pushBack(x);
+        }
+        // non-empty from here on: no emptiness checks needed
+        Summary s;
+        s.size = sz;
+        if constexpr ((Fields & SumMin) != 0) s.min = *allVals.begin();
+        if constexpr ((Fields & SumMax) != 0) s.max = *allVals.rbegin();
+        if constexpr ((Fields & SumMedian) != 0)
+            s.median = lower.size() > upper.size() ? (double)*lower.rbegin()
+                                                   : ((double)*lower.rbegin() + (double)*upper.begin()) / 2.0;
+        if constexpr ((Fields & SumMode) != 0) s.mode = modeVal;
+        return s;
+    }
+    // The statistics selected by fields, as pushAndSummarize reports them
+    Summary summary(unsigned fields = SumAll) const {
+        Summary s;
+        s.size = sz;
+        if (sz == 0) return s;
+        if (fields & SumMin) s.min = getMin();
+        if (fields & SumMax) s.max = getMax();
+        if (fields & SumMedian) s.median = getMedian();
+        if (fields & SumMode) s.mode = getMode();
+        return s;
+    }
+
+    // ---------- Delete / Update ----------
+    // delete one occurrence of x (if exists)
+    bool deleteVal(int x) {
+        const ValInfo* vi = vals.find(x);
+        if (!vi) return false;
+        UpdateScope ns(*this);
+        Node* node = vi->first;
+        detach(node);
+        removeValueStructures(x, node);
+        dispose(node);
+        record(ChangeOp::DeleteVal, x);
+        return true;
+    }
+
+    // update one occurrence of oldVal to newVal
+    bool update(int oldVal, int newVal) {
+        const ValInfo* vi = vals.find(oldVal);
+        if (!vi) return false;
+        UpdateScope ns(*this);
+        Node* node = vi->first;
+        // the node stays in place; move it from oldVal's tracking to newVal's
+        removeValueStructures(oldVal, node);
+        __atomic_store_n(&node->val, newVal, __ATOMIC_RELAXED);     // shared readers may be reading it
+        addValueStructures(newVal, node);
+        record(ChangeOp::Update, oldVal, (uint32_t)newVal);
+        return true;
+    }
+
+    // ---------- Traversal / Kth ----------
+    void traverse(ostream& os = cout) const {
+        for (Node* cur = head; cur; cur = cur->next) os << cur->val << ' ';
+        os << '\n';
+    }
+    // visit(v) for each value in list order. O(n)
+    template<class F>
+    void forEach(F &&visit) const {
+        for (Node* cur = head; cur; cur = cur->next) visit(cur->val);
+    }
+    // kth (0-indexed), walking from the nearest of head, tail and the finger left
+    // by the previous call: sequential or nearby access is O(distance).
+    // Not thread-safe even though const: it moves the finger, so concurrent callers,
+    // const ones included, must not share an instance.
+    bool getKth(size_t k, int &out) const {
+        if (k >= sz) return false;
+        Node* cur = head;
+        size_t pos = 0;
+        size_t fromFinger = finger ? max(k, fingerPos) - min(k, fingerPos) : SIZE_MAX;
+        if (fromFinger <= k && fromFinger <= sz - 1 - k) { cur = finger; pos = fingerPos; }
+        else if (sz - 1 - k < k) { cur = tail; pos = sz - 1; }
+        for (; pos < k; pos++) cur = cur->next;
+        for (; pos > k; pos--) cur = cur->prev;
+        finger = cur;
+        fingerPos = k;
+        out = cur->val;
+        return true;
+    }
+
+    // ---------- Reverse / Rotate ----------
+    // Reverse in O(n)
+    void reverse() {
+        if (head) reverseFrom(head);
+        record(ChangeOp::Reverse);
+        // values unchanged; auxiliary structures unaffected
+    }
+
+    // Rotate right by k (last k become first). O(n) to locate split.
+    void rotate(size_t k) {
+        if (sz == 0) return;
+        record(ChangeOp::Rotate, 0, k);
+        k %= sz;
+        if (k == 0) return;
+        // newTail at position sz-k-1, newHead at sz-k
+        size_t steps = sz - k - 1;
+        Node* newTail = head;
+        while (steps--) newTail = newTail->next;
+        Node* newHead = newTail->next;
+
+        // reconnect
+        finger = nullptr;
+        relinkBegin();
+        publish(newTail->next, nullptr);
+        newHead->prev = nullptr;
+        publish(tail->next, head);
+        head->prev = tail;
+
+        publish(head, newHead);
+        tail = newTail;
+        relinkEnd();
+    }
+
+    // ---------- Random ----------
+    int getRandom() {
+        if (pool.empty()) return INT_MIN;
+        uniform_int_distribution<size_t> dist(0, pool.size()-1);
+        Node* node = pool[dist(rng)];
+        return node->val;
+    }
+    // Reseed the engine behind getRandom (for ThreadLocalRng: the calling thread's engine)
+    void seed(uint64_t s) { rng.seed(s); }
+
+    // ---------- Unique / Remove Duplicates ----------
+    vector<int> uniqueElements() const {
+        vector<int> keys;
+        keys.reserve(vals.size());
+        vals.forEach([&](int v, const ValInfo &) { keys.push_back(v); });
+        return keys;
+    }
+
+    // keep first occurrence order, remove later duplicates (O(n))
+    void removeDuplicates() {
+        UpdateScope ns(*this);
+        unordered_set<int> seen;
+        for (Node* cur = head; cur; ) {
+            Node* nxt = cur->next;
+            if (seen.count(cur->val)) {
+                // remove this node
+                int x = cur->val;
+                detach(cur);
+                removeValueStructures(x, cur);
+                dispose(cur);
+            } else {
+                seen.insert(cur->val);
+            }
+            cur = nxt;
+        }
+        record(ChangeOp::RemoveDuplicates);
+    }
+
+    // ---------- Multiset algebra ----------
+    // Computed on the frequency indices (hash probes, no intermediate vectors).
+    // The visitor forms call visit(value, count) once per resulting value, in
+    // unspecified order; the plain forms collect the same pairs.
+
+    // min(count here, count there) for values in both: O(smaller distinct count)
+    template<class F>
+    void intersectCounts(const BasicAdvancedDS &other, F &&visit) const {
+        const auto &small = vals.size() <= other.vals.size() ? vals : other.vals;
+        const auto &big = &small == &vals ? other.vals : vals;
+        small.forEach([&](int v, const ValInfo &vi) {
+            if (const ValInfo* o = big.find(v)) visit(v, min(vi.cnt, o->cnt));
+        });
+    }
+    // max(count here, count there) for values in either: O(distinct here + distinct there)
+    template<class F>
+    void unionCounts(const BasicAdvancedDS &other, F &&visit) const {
+        vals.forEach([&](int v, const ValInfo &vi) { visit(v, max(vi.cnt, other.getFrequency(v))); });
+        other.vals.forEach([&](int v, const ValInfo &vi) {
+            if (!vals.count(v)) visit(v, vi.cnt);
+        });
+    }
+    // count here - count there, where positive: O(distinct here)
+    template<class F>
+    void difference(const BasicAdvancedDS &other, F &&visit) const {
+        vals.forEach([&](int v, const ValInfo &vi) {
+            int c = vi.cnt - other.getFrequency(v);
+            if (c > 0) visit(v, c);
+        });
+    }
+
+    vector<pair<int,int>> intersectCounts(const BasicAdvancedDS &other) const {
+        vector<pair<int,int>> out;
+        intersectCounts(other, [&](int v, int c) { out.emplace_back(v, c); });
+        return out;
+    }
+    vector<pair<int,int>> unionCounts(const BasicAdvancedDS &other) const {
+        vector<pair<int,int>> out;
+        out.reserve(max(vals.size(), other.vals.size()));
+        unionCounts(other, [&](int v, int c) { out.emplace_back(v, c); });
+        return out;
+    }
+    vector<pair<int,int>> difference(const BasicAdvancedDS &other) const {
+        vector<pair<int,int>> out;
+        difference(other, [&](int v, int c) { out.emplace_back(v, c); });
+        return out;
+    }
+
+    // ---------- Sorting / Permutations ----------
+    // First k positions become the k smallest values, ascending; the other nodes keep
+    // their relative order. Reads the order from allVals: O(k), no rebuild.
+    void partialSortAscending(size_t k) {
+        gatherSorted<true>(allVals.begin(), min(k, sz));
+        record(ChangeOp::PartialSort, 0, k);
+    }
+    // Position k gets the value it would have after a full sort, with nothing larger
+    // before it and nothing smaller after it. Sorts whichever side of k is shorter:
+    // O(min(k, n-k)), no rebuild.
+    void nthElement(size_t k) {
+        if (k >= sz) return;
+        if (k + 1 <= sz - k) gatherSorted<true>(allVals.begin(), k + 1);
+        else gatherSorted<false>(allVals.rbegin(), sz - k);
+        record(ChangeOp::NthElement, 0, k);
+    }
+
+    void sortAscending() {
+        mergeSortNodes(less<int>());
+        record(ChangeOp::SortAscending);
+    }
+    void sortDescending() {
+        mergeSortNodes(greater<int>());
+        record(ChangeOp::SortDescending);
+    }
+
+    // Stable sort by key(value), relinking nodes: node identity and every index stay valid
+    template<class KeyFn>
+    void stableSortBy(KeyFn key) {
+        mergeSortNodes([&key](int a, int b) { return key(a) < key(b); });
+        record(ChangeOp::Resync);
+    }
+    // Relink nodes satisfying pred to the front, both groups keeping their order. O(n).
+    // Returns the size of the front group.
+    template<class Pred>
+    size_t stablePartition(Pred pred) {
+        Node *yesH = nullptr, *yesT = nullptr, *noH = nullptr, *noT = nullptr;
+        size_t cnt = 0;
+        relinkBegin();
+        for (Node* cur = head; cur; ) {
+            Node* nxt = cur->next;
+            bool yes = pred(cur->val);
+            Node *&h = yes ? yesH : noH, *&t = yes ? yesT : noT;
+            cur->prev = t;
+            publish(cur->next, nullptr);
+            if (t) publish(t->next, cur); else h = cur;
+            t = cur;
+            cnt += yes;
+            cur = nxt;
+        }
+        finger = nullptr;
+        publish(head, yesH ? yesH : noH);
+        tail = noT ? noT : yesT;
+        if (yesT && noH) { publish(yesT->next, noH); noH->prev = yesT; }
+        relinkEnd();
+        record(ChangeOp::Resync);
+        return cnt;
+    }
+
+    // In place on the list: find the pivot walking back from tail, swap it with its
+    // successor value, reverse the suffix. Only the suffix nodes are relinked and they
+    // keep their values, so no index changes. Amortized O(1) per step over a full
+    // enumeration; O(n) when wrapping around (returns false, like std::next_permutation).
+    bool nextPermutation() {
+        if (sz <= 1) return false;
+        record(ChangeOp::NextPermutation);
+        Node* i = tail;
+        while (i->prev && i->prev->val >= i->val) i = i->prev;
+        if (!i->prev) { reverseFrom(head); return false; }
+        Node* pivot = i->prev;
+        Node* j = tail;
+        while (j->val <= pivot->val) j = j->prev;
+        swapNodes(pivot, j);
+        reverseFrom(j->next);
+        return true;
+    }
+    bool prevPermutation() {
+        if (sz <= 1) return false;
+        record(ChangeOp::PrevPermutation);
+        Node* i = tail;
+        while (i->prev && i->prev->val <= i->val) i = i->prev;
+        if (!i->prev) { reverseFrom(head); return false; }
+        Node* pivot = i->prev;
+        Node* j = tail;
+        while (j->val >= pivot->val) j = j->prev;
+        swapNodes(pivot, j);
+        reverseFrom(j->next);
+        return true;
+    }
+
+    // ---------- Merge / Split / Clear ----------
+    // Append all from other to this (other becomes empty). O(min(n, n_other)) index moves:
+    // when other is the larger one, its storage is taken over and ours moved in front.
+    void merge(BasicAdvancedDS &other) {
+        if (other.sz == 0 || &other == this) return;
+        reserveRoom(other.sz);
+        UpdateScope ns(*this), nsOther(other);
+        touch(); other.touch();     // swapContents below bypasses the value hooks
+        shareReaders(other);
+        relinkBegin(); other.relinkBegin();
+        beginBulk(); other.beginBulk();
+        if (other.sz > sz) {
+            swapContents(other);
+            while (other.sz) other.moveNodeTo(other.tail, *this, true);
+        } else {
+            while (other.sz) other.moveNodeTo(other.head, *this, false);
+        }
+        other.endBulk(); endBulk();
+        other.relinkEnd(); relinkEnd();
+        record(ChangeOp::Resync); other.record(ChangeOp::Resync);
+    }
+
+    // Split after k nodes (left keeps first k, right gets the rest).
+    // O(min(k, n-k)) index moves: the shorter side is the one that gets moved.
+    BasicAdvancedDS split(size_t k) {
+        BasicAdvancedDS right;
+        right.ttlNow = ttlNow;
+        right.shared = shared;
+        if (k >= sz) return right;
+        UpdateScope ns(*this);
+        touch();
+        relinkBegin();
+        beginBulk(); right.beginBulk();
+        if (k <= sz - k) {
+            swapContents(right);
+            while (sz < k) right.moveNodeTo(right.head, *this, false);
+        } else {
+            while (sz > k) moveNodeTo(tail, right, true);
+        }
+        right.endBulk(); endBulk();
+        relinkEnd();
+        record(ChangeOp::Resync);
+        return right;
+    }
+
+    void clear() {
+        UpdateScope ns(*this);
+        touch();
+        record(ChangeOp::Clear);
+        if (RealTime || deferred || shared) {
+            // O(1): park storage in a graveyard, freed by later updates or the reclaimer
+            if (!head) return;
+            Graveyard* g = new Graveyard;
+            g->bytes = memBytes - (wheel ? (int64_t)SmallPool::blockBytes(sizeof(TimingWheel)) : 0);
+            memBytes -= g->bytes;   // all of it moves there but the wheel
+            g->nodes = head;
+            publish(head, nullptr);     // unlinked before it is retired
+            g->vals.swap(vals);
+            g->allVals.swap(allVals);
+            g->lower.swap(lower);
+            g->upper.swap(upper);
+            if constexpr (RealTime) g->modeIdx.swap(modeIdx);
+            g->pool.swap(pool);
+            if (shared) EpochDomain::instance().retire(g, [](void* p) {
+                BackgroundReclaimer::instance().post(static_cast<Graveyard*>(p));
+            });
+            else if (deferred) BackgroundReclaimer::instance().post(g);
+            else {
+                g->older = graves;
+                graves = g;
+            }
+        } else {
+            Node* cur = head;
+            while (cur) {
+                Node* nxt = cur->next;
+                delete cur;
+                cur = nxt;
+            }
+            vals.clear();
+            allVals.clear();
+            lower.clear();
+            upper.clear();
+        }
+        publish(head, nullptr);
+        tail = nullptr;
+        finger = nullptr;
+        if (wheel) wheel->reset();  // the timers go with their nodes
+        sz = 0;
+        pool.clear();   // graveyard path: already handed over, nothing left to free
+        modeCnt = 0;
+        modeVal = 0;
+    }
+    // Free storage left behind by RealTime clear(): at most `budget` items, or all of it
+    void reclaim(size_t budget = SIZE_MAX) { reclaimStep(budget); }
+    // Free detached storage on the background reclaimer thread from now on
+    void setDeferredReclaim(bool on) {
+        deferred = on;
+        if (on) postGraves();
+    }
+
+    // ---------- Shared readers ----------
+    // Turn on before the first walkShared. Updates still need one writer at a time;
+    // walkShared may then run on any number of other threads, each inside an
+    // EpochDomain::Guard, without that lock. Removed nodes (pops, deleteVal, expiry,
+    // removeDuplicates) are retired to EpochDomain instead of freed, clear() retires
+    // its whole graveyard, later freed by BackgroundReclaimer. A reader may stand on a
+    // node that merge, split, swap or a move hands to another container, so the
+    // setting spreads to that container (split's result, both sides of the others).
+    void setSharedReaders(bool on) { shared = on; }
+    // visit(v) for each value from the head on, until it returns false. Returns false
+    // when a relink (sorts, reverse, rotate, permutations, partitions, merge, split,
+    // swap) raced the walk: retry from scratch. Otherwise every element present for the
+    // whole walk was visited, in list order; those pushed or removed meanwhile may or
+    // may not have been.
+    template<class F>
+    bool walkShared(F &&visit) const {
+        uint64_t s0 = relinkSeq.load(memory_order_acquire);
+        if (s0 & 1) return false;
+        size_t steps = 0;
+        for (Node* cur = observe(head); cur; cur = observe(cur->next)) {
+            if (!visit(__atomic_load_n(&cur->val, __ATOMIC_RELAXED))) break;
+            // a relink may briefly close a cycle: notice it without reaching the end
+            if (++steps % 64 == 0 && relinkSeq.load(memory_order_acquire) != s0) return false;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        return relinkSeq.load(memory_order_relaxed) == s0;
+    }
+
+    // ---------- Change notifications ----------
+    // Subscribers hear about min / max / median / mode changes instead of polling.
+    // The value hooks note that an operation touched the statistics; when the
+    // operation (or an enclosing notification batch) ends, the watched ones are read
+    // once and compared, and a callback runs only if a statistic it watches moved.
+    // Nothing is read or compared while nobody subscribes. Callbacks run on the
+    // updating thread and may read the container, but must not update it, subscribe or
+    // unsubscribe, or throw. swap and moves carry no notifications.
+    using ChangeFn = function<void(const Summary &before, const Summary &after, unsigned changed)>;
+    // fn(before, after, changed) whenever a SummaryField in fields changed; changed holds
+    // the bits that did. Returns an id for unsubscribe.
+    uint64_t subscribe(unsigned fields, ChangeFn fn) {
+        if (!watch) watch = make_unique<Watchers>();
+        watch->list.push_back({watch->nextId, fields, std::move(fn)});
+        watch->fields |= fields;
+        return watch->nextId++;
+    }
+    // fn(value, rising) when field crosses level: rising when it went from below level
+    // to level or above, falling for the way back. An empty container crosses nothing.
+    uint64_t subscribeCrossing(SummaryField field, double level, function<void(double, bool)> fn) {
+        return subscribe(field, [field, level, fn = std::move(fn)](const Summary &b, const Summary &a, unsigned) {
+            if (b.size == 0 || a.size == 0) return;
+            double x = statOf(b, field), y = statOf(a, field);
+            if (x < level && y >= level) fn(y, true);
+            else if (x >= level && y < level) fn(y, false);
+        });
+    }
+    bool unsubscribe(uint64_t id) {
+        if (!watch) return false;
+        auto &l = watch->list;
+        auto it = find_if(l.begin(), l.end(), [&](const Watcher &w) { return w.id == id; });
+        if (it == l.end()) return false;
+        l.erase(it);
+        watch->fields = 0;
+        for (const Watcher &w : l) watch->fields |= w.fields;
+        if (l.empty() && watch->depth == 0) watch.reset();
+        return true;
+    }
+    // Operations between these notify once, comparing against the state before the first
+    void beginNotifyBatch() {
+        if (!watch) watch = make_unique<Watchers>();
+        watch->depth++;
+    }
+    void endNotifyBatch() {
+        if (watch && --watch->depth == 0 && watch->touched) notify();
+    }
+
+    // ---------- Change feed ----------
+    // Every mutation from here on is published to feed (nullptr detaches), by the
+    // updating thread; the feed is not owned and must outlive the attachment. Mirrors
+    // follow with ChangeFeed::read + applyChange. To start one, take assignFrom(src)
+    // and cursor = feed.end() together, under the lock that serializes src's updates.
+    void attachChangeFeed(ChangeFeed* f) { feed = f; }
+    // Replay one event from another container's feed. Returns false on Resync: the
+    // mirror can no longer follow and must be reloaded with assignFrom. A mirror that
+    // has seen the same events from the same state ends with the same list, and the
+    // same occurrence goes first for deleteVal / update (getRandom draws differ).
+    bool applyChange(const ChangeEvent &e) {
+        switch (e.op) {
+        case ChangeOp::PushBack: pushBack(e.x); break;
+        case ChangeOp::PushFront: pushFront(e.x); break;
+        case ChangeOp::PushBackTtl: pushBack(e.x, e.arg); break;
+        case ChangeOp::PopBack: popBack(); break;
+        case ChangeOp::PopFront: popFront(); break;
+        case ChangeOp::DeleteVal: deleteVal(e.x); break;
+        case ChangeOp::Update: update(e.x, (int)(uint32_t)e.arg); break;
+        case ChangeOp::Expire: expire(e.arg); break;
+        case ChangeOp::RemoveDuplicates: removeDuplicates(); break;
+        case ChangeOp::Rotate: rotate(e.arg); break;
+        case ChangeOp::Reverse: reverse(); break;
+        case ChangeOp::SortAscending: sortAscending(); break;
+        case ChangeOp::SortDescending: sortDescending(); break;
+        case ChangeOp::PartialSort: partialSortAscending(e.arg); break;
+        case ChangeOp::NthElement: nthElement(e.arg); break;
+        case ChangeOp::NextPermutation: nextPermutation(); break;
+        case ChangeOp::PrevPermutation: prevPermutation(); break;
+        case ChangeOp::Clear: clear(); break;
+        case ChangeOp::Resync: return false;
+        }
+        return true;
+    }
+    // Replay a batch, the mode rescans some removals need (default mode) folded into
+    // one at the end. Returns how many were applied: up to, not including, a Resync.
+    size_t applyChanges(const ChangeEvent* e, size_t n) {
+        UpdateScope ns(*this);
+        beginBulk();
+        size_t i = 0;
+        while (i < n && applyChange(e[i])) i++;
+        endBulk();
+        return i;
+    }
+    // Become an exact replica of src (list, pending expiries, which occurrence of a
+    // value goes first), the snapshot a mirror starts from. O(n log n). Published to our
+    // own feed, if any, as Clear + Resync.
+    void assignFrom(const BasicAdvancedDS &src) {
+        if (&src == this) return;
+        UpdateScope ns(*this);
+        clear();
+        ttlNow = src.ttlNow;
+        unordered_map<const Node*, Node*> copyOf;
+        copyOf.reserve(src.sz);
+        for (Node* cur = src.head; cur; cur = cur->next) {
+            Node* node = append(cur->val);
+            if (cur->timer) arm(node, cur->timer->deadline);
+            copyOf.emplace(cur, node);
+        }
+        // rechain each value's occurrences in src's order
+        src.vals.forEach([&](int v, const ValInfo &si) {
+            ValInfo &vi = *vals.find(v);
+            Node* prev = nullptr;
+            for (Node* o = si.first; o; o = o->vnext) {
+                Node* node = copyOf[o];
+                node->vprev = prev;
+                if (prev) prev->vnext = node; else vi.first = node;
+                prev = node;
+            }
+            prev->vnext = nullptr;
+        });
+        record(ChangeOp::Resync);
+    }
+    // assignFrom across processes: a flat image of the same state, O(n) to write.
+    // Words: size, expiry clock, then per element in list order (uint32 value | its
+    // rank among the occurrences of that value << 32) and (deadline + 1, or 0).
+    void saveSnapshot(vector<uint64_t> &out) const {
+        out.clear();
+        out.reserve(2 + 2 * sz);
+        out.push_back(sz);
+        out.push_back(ttlNow);
+        unordered_map<const Node*, uint32_t> rank;
+        rank.reserve(sz);
+        vals.forEach([&](int, const ValInfo &vi) {
+            uint32_t r = 0;
+            for (Node* o = vi.first; o; o = o->vnext) rank.emplace(o, r++);
+        });
+        for (Node* cur = head; cur; cur = cur->next) {
+            out.push_back((uint32_t)cur->val | (uint64_t)rank[cur] << 32);
+            out.push_back(cur->timer ? cur->timer->deadline + 1 : 0);
+        }
+    }
+    // Replace our contents with a saveSnapshot image; false (and left empty) when
+    // it is malformed. O(n log n).
+    bool loadSnapshot(const uint64_t* w, size_t words) {
+        UpdateScope ns(*this);
+        clear();
+        if (words < 2 || words != 2 + 2 * w[0]) return false;
+        ttlNow = w[1];
+        vector<Node*> nodes;
+        nodes.reserve(w[0]);
+        for (size_t i = 0; i < w[0]; i++) {
+            uint64_t e = w[2 + 2 * i], deadline = w[3 + 2 * i];
+            Node* node = append((int)(uint32_t)e);
+            if (deadline) arm(node, deadline - 1);
+            nodes.push_back(node);
+        }
+        // rechain each value's occurrences by rank
+        unordered_map<int, vector<Node*>> byRank;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            uint32_t r = (uint32_t)(w[2 + 2 * i] >> 32);
+            vector<Node*> &chain = byRank[nodes[i]->val];
+            if (chain.empty()) chain.assign(vals.find(nodes[i]->val)->cnt, nullptr);
+            if (r >= chain.size() || chain[r]) { clear(); return false; }
+            chain[r] = nodes[i];
+        }
+        for (auto &[v, chain] : byRank) {
+            for (size_t r = 0; r < chain.size(); r++) {
+                chain[r]->vprev = r ? chain[r - 1] : nullptr;
+                chain[r]->vnext = r + 1 < chain.size() ? chain[r + 1] : nullptr;
+            }
+            vals.find(v)->first = chain[0];
+        }
+        record(ChangeOp::Resync);
+        return true;
+    }
+
+    // ---------- Memory budget ----------
+    // Which elements go when an update leaves the container above its budget
+    enum class Evict { Oldest, LeastFrequent, Random };
+    // Cap memoryUsed() at bytes (0: no cap). An update that ends above it evicts, by
+    // policy, in batches until below 15/16 of the budget: Oldest pops the front,
+    // LeastFrequent removes an occurrence of the rarest values (RealTime: O(log n)
+    // each; otherwise one O(distinct) scan per batch), Random removes the value of a
+    // random element. Batches start at EvictBatch and are then sized by the bytes each
+    // eviction returned. Evictions are ordinary deleteVal / popFront calls, so they
+    // reach subscribers and the change feed like any other. Storage still parked by
+    // clear() is freed first. The hash table and the random pool shrink with the size;
+    // a budget below what an emptied container still holds (its smallest table and
+    // pool chunk, the expiry wheel) cannot be met, and the contents are then kept:
+    // memoryUsed() stays above memoryBudget().
+    void setMemoryBudget(size_t bytes, Evict policy = Evict::Oldest) {
+        UpdateScope us(*this);
+        memBudget = bytes;
+        evictPolicy = policy;
+    }
+    size_t memoryBudget() const { return memBudget; }
+    // Bytes of nodes, indices, tables and timers held, counted by the allocators
+    // (MemoryCounter). Storage clear() parked for later updates (RealTime) is included;
+    // storage handed to the background reclaimer or to EpochDomain (deferred reclaim,
+    // shared readers) is not, though it may take a while to be freed.
+    size_t memoryUsed() const {
+        int64_t b = memBytes;
+        for (Graveyard* g = graves; g; g = g->older) b += g->bytes;
+        return (size_t)max<int64_t>(b, 0);
+    }
+
+private:
+    int64_t memBytes = 0;           // charged by our updates, graveyards apart
+    size_t memBudget = 0;           // setMemoryBudget; 0: none
+    Evict evictPolicy = Evict::Oldest;
+    int updateDepth = 0;            // open UpdateScopes
+    static constexpr size_t EvictBatch = 64;
+
+    // What an emptied container still holds: no eviction gets below it
+    size_t floorBytes() const {
+        return (wheel ? SmallPool::blockBytes(sizeof(TimingWheel)) : 0) + pool.minBytes() + vals.minBytes();
+    }
+    void evictToBudget() {
+        const size_t low = memBudget - memBudget / 16;
+        if (floorBytes() >= low) return;
+        vector<pair<int,int>> rare;     // (count, value), default-mode LeastFrequent
+        size_t k = EvictBatch;
+        beginBulk();    // default mode: a mode removed over and over is rescanned once
+        for (size_t used; (used = memoryUsed()) > low && (sz || graves); ) {
+            if (graves) { reclaimStep(EvictBatch); continue; }
+            k = min(k, sz);
+            evictBatch(k, rare);
+            vals.shrinkToFit();     // what the evictions freed room for, at once
+            pool.shrinkToFit();
+            size_t after = memoryUsed();
+            if (after >= used) break;   // nothing came back: stop rather than empty it
+            // the next batch: what is left over at the bytes per eviction so far, at
+            // most doubling and at most half of what is left (table and pool capacity
+            // come back in steps, so that rate is not to be trusted far)
+            k = clamp(after > low ? (after - low) / ((used - after) / k + 1) + 1 : 0,
+                      EvictBatch, min(2 * k, max(EvictBatch, sz / 2)));
+        }
+        endBulk();
+    }
+    void evictBatch(size_t k, vector<pair<int,int>> &rare) {
+        switch (evictPolicy) {
+        case Evict::Oldest:
+            while (k--) popFront();
+            break;
+        case Evict::Random:
+            while (k--) deleteVal(pool[uniform_int_distribution<size_t>(0, sz - 1)(rng)]->val);
+            break;
+        case Evict::LeastFrequent:
+            if constexpr (RealTime) {
+                while (k--) deleteVal(modeIdx.rbegin()->second);
+            } else {
+                rare.clear();
+                vals.forEach([&](int v, const ValInfo &vi) { rare.emplace_back(vi.cnt, v); });
+                k = min(k, rare.size());
+                nth_element(rare.begin(), rare.begin() + (k - 1), rare.end());
+                for (size_t i = 0; i < k; i++) deleteVal(rare[i].second);
+            }
+            break;
+        }
+    }
+
+    struct Watcher {
+        uint64_t id;
+        unsigned fields;
+        ChangeFn fn;
+    };
+    struct Watchers {
+        vector<Watcher> list;
+        unsigned fields = 0;        // union over list
+        uint64_t nextId = 1;
+        int depth = 0;              // open operations and batches
+        bool touched = false;       // before holds the state the open group started from
+        Summary before;
+    };
+    unique_ptr<Watchers> watch;     // created by the first subscribe
+
+    // Brackets a public update: what it allocates and frees is charged to memBytes,
+    // and the outermost one enforces the memory budget, then notifies
+    struct UpdateScope {
+        BasicAdvancedDS &d;
+        bool notifying;
+        ChargeTo charge;
+        explicit UpdateScope(BasicAdvancedDS &ds): d(ds), notifying(ds.watch != nullptr), charge(&ds.memBytes) {
+            d.updateDepth++;
+            if (notifying) d.watch->depth++;
+        }
+        ~UpdateScope() {
+            if (d.updateDepth == 1 && d.memBudget && d.memoryUsed() > d.memBudget) d.evictToBudget();
+            d.updateDepth--;
+            if (notifying && --d.watch->depth == 0 && d.watch->touched) d.notify();
+        }
+    };
+    // About to change the statistics: remember them, once per group. All of them, so
+    // a subscription made meanwhile compares against real values.
+    void touch() {
+        if (!watch || watch->touched || !watch->fields) return;
+        watch->touched = true;
+        watch->before = summary();
+    }
+    void notify() {
+        Watchers &w = *watch;
+        w.touched = false;
+        Summary a = summary();
+        const Summary &b = w.before;
+        unsigned changed = 0;
+        if (a.min != b.min) changed |= SumMin;
+        if (a.max != b.max) changed |= SumMax;
+        if (!(a.median == b.median || (std::isnan(a.median) && std::isnan(b.median)))) changed |= SumMedian;
+        if (a.mode != b.mode) changed |= SumMode;
+        changed &= w.fields;
+        if (!changed) return;
+        for (const Watcher &x : w.list)
+            if (x.fields & changed) x.fn(b, a, changed & x.fields);
+    }
+    static double statOf(const Summary &s, SummaryField f) {
+        switch (f) {
+        case SumMin: return s.min;
+        case SumMax: return s.max;
+        case SumMedian: return s.median;
+        default: return s.mode;
+        }
+    }
+};
+
+using AdvancedDS = BasicAdvancedDS<>;
+using RealTimeAdvancedDS = BasicAdvancedDS<Xoshiro256ss, true>;
+
+// ----------------- Wait word -----------------
+// A 32-bit word threads can sleep on until it changes: a futex on Linux, a
+// condition variable elsewhere.
+class WaitWord {
+public:
+    atomic<uint32_t> value{0};
+
+    // Sleep while value == expected, at most timeout; false once it timed out
+    bool wait(uint32_t expected, chrono::nanoseconds timeout) {
+        bool forever = timeout == chrono::nanoseconds::max();
+#ifdef __linux__
+        timespec ts{(time_t)(timeout.count() / 1000000000), (long)(timeout.count() % 1000000000)};
+        long r = syscall(SYS_futex, &value, FUTEX_WAIT_PRIVATE, expected, forever ? nullptr : &ts, nullptr, 0);
+        return !(r == -1 && errno == ETIMEDOUT);
+#else
+        unique_lock<mutex> lk(m);
+        auto changed = [&] { return value.load() != expected; };
+        if (forever) { cv.wait(lk, changed); return true; }
+        return cv.wait_for(lk, timeout, changed);
+#endif
+    }
+    // Wake up to n sleepers (INT_MAX: all)
+    void wake(int n) {
+#ifdef __linux__
+        syscall(SYS_futex, &value, FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+#else
+        lock_guard<mutex> lk(m);
+        if (n == 1) cv.notify_one(); else cv.notify_all();
+#endif
+    }
+
+private:
+#ifndef __linux__
+    mutex m;
+    condition_variable cv;
+#endif
+};
+
+// ----------------- Concurrent wrapper -----------------
+// A container shared by producer and consumer threads behind one mutex. Consumers
+// block instead of polling: popFrontWait / popFrontBatch sleep on a WaitWord that
+// every push bumps, and a push makes the wake-up syscall only when someone sleeps.
+// pushBackMany publishes a whole batch with one wake-up; popFrontBatch drains up
+// to max elements per lock. With coroutines, co_await popFrontAsync() suspends
+// instead, and a push hands its element straight to the oldest suspended awaiter,
+// resuming it on the pushing thread (awaiters still suspended when the wrapper is
+// destroyed are never resumed). Anything else goes through withLock(f).
+// Constructed with sharedReaders = true, traverseShared / getKthShared walk the list
+// without the mutex, so an O(n) read never holds up the writers; nodes removed under
+// them are freed through EpochDomain once no walk can reach them. A walk that races
+// a relinking operation (sort, reverse, ...) starts over, after a few tries under m.
+template<class DS = AdvancedDS>
+class ConcurrentAdvancedDS {
+public:
+    explicit ConcurrentAdvancedDS(bool sharedReaders = false): sharedReaders(sharedReaders) {
+        ds.setSharedReaders(sharedReaders);
+    }
+
+#ifdef __cpp_impl_coroutine
+    struct PopAwaiter {
+        ConcurrentAdvancedDS* q;
+        int value = 0;
+        coroutine_handle<> handle = nullptr;
+        PopAwaiter* nextWaiter = nullptr;
+
+        bool await_ready() { return q->tryPopFront(value); }
+        bool await_suspend(coroutine_handle<> h) {
+            lock_guard<mutex> lk(q->m);
+            if (q->takeFront(value)) return false;
+            handle = h;
+            if (q->awaitTail) q->awaitTail->nextWaiter = this; else q->awaitHead = this;
+            q->awaitTail = this;
+            return true;
+        }
+        int await_resume() const { return value; }
+    };
+    // co_await popFrontAsync(): the front element, suspending while there is none
+    PopAwaiter popFrontAsync() { return PopAwaiter{this}; }
+#endif
+
+    void pushBack(int x) {
+        unique_lock<mutex> lk(m);
+#ifdef __cpp_impl_coroutine
+        if (PopAwaiter* a = takeAwaiter()) {
+            a->value = x;
+            lk.unlock();
+            a->handle.resume();
+            return;
+        }
+#endif
+        ds.pushBack(x);
+        lk.unlock();
+        published(1);
+    }
+    // Push [first, last) under one lock and wake the sleepers once
+    template<class It>
+    void pushBackMany(It first, It last) {
+        unique_lock<mutex> lk(m);
+#ifdef __cpp_impl_coroutine
+        PopAwaiter *served = nullptr, **servedTail = &served;
+        for (; first != last && awaitHead; ++first) {
+            PopAwaiter* a = takeAwaiter();
+            a->value = *first;
+            *servedTail = a;
+            servedTail = &a->nextWaiter;
+        }
+#endif
+        bool any = first != last;
+        for (; first != last; ++first) ds.pushBack(*first);
+        lk.unlock();
+#ifdef __cpp_impl_coroutine
+        while (PopAwaiter* a = served) {
+            served = a->nextWaiter;     // a lives in the frame being resumed
+            a->handle.resume();
+        }
+#endif
+        if (any) published(INT_MAX);
+    }
+
+    bool tryPopFront(int &out) {
+        lock_guard<mutex> lk(m);
+        return takeFront(out);
+    }
+    // Block until an element arrives or timeout passes; false on timeout
+    bool popFrontWait(int &out, chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        return waitAndTake(timeout, [&] { return takeFront(out) ? 1 : 0; }) != 0;
+    }
+    // Block until at least one element is there (or timeout), then move up to max of
+    // them to out in one go. Returns how many were taken (0 on timeout).
+    size_t popFrontBatch(size_t max, vector<int> &out, chrono::nanoseconds timeout = chrono::nanoseconds::max()) {
+        if (max == 0) return 0;
+        return waitAndTake(timeout, [&] {
+            size_t n = 0;
+            for (int x; n < max && takeFront(x); n++) out.push_back(x);
+            return n;
+        });
+    }
+
+    // Run f(container) under the lock
+    template<class F>
+    decltype(auto) withLock(F &&f) {
+        lock_guard<mutex> lk(m);
+        return f(ds);
+    }
+    size_t size() const {
+        lock_guard<mutex> lk(m);
+        return ds.size();
+    }
+
+    // ---- Lock-free reads (under the mutex unless constructed with sharedReaders) ----
+    // The values in list order
+    void traverseShared(vector<int> &out) {
+        readShared([&] {
+            out.clear();
+            return ds.walkShared([&](int v) { out.push_back(v); return true; });
+        });
+    }
+    // kth (0-indexed): O(k) from the head
+    bool getKthShared(size_t k, int &out) {
+        bool found = false;
+        readShared([&] {
+            size_t i = 0;
+            found = false;
+            return ds.walkShared([&](int v) {
+                if (i++ < k) return true;
+                out = v;
+                found = true;
+                return false;
+            });
+        });
+        return found;
+    }
+
+private:
+    static constexpr int SharedTries = 4;
+    mutable mutex m;
+    DS ds;
+    const bool sharedReaders;
+    WaitWord seq;                   // bumped after every push
+    atomic<int> sleepers{0};
+#ifdef __cpp_impl_coroutine
+    PopAwaiter *awaitHead = nullptr, *awaitTail = nullptr;   // FIFO, under m
+
+    PopAwaiter* takeAwaiter() {
+        PopAwaiter* a = awaitHead;
+        if (!a) return nullptr;
+        awaitHead = a->nextWaiter;
+        if (!awaitHead) awaitTail = nullptr;
+        a->nextWaiter = nullptr;
+        return a;
+    }
+#endif
+
+    // walk() returns false when it has to start over; under m it never does
+    template<class Walk>
+    void readShared(Walk walk) {
+        if (sharedReaders) {
+            EpochDomain::Guard g;
+            for (int i = 0; i < SharedTries; i++) if (walk()) return;
+        }
+        lock_guard<mutex> lk(m);
+        walk();
+    }
+    bool takeFront(int &out) {      // under m
+        if (ds.empty()) return false;
+        out = ds.front();
+        ds.popFront();
+        return true;
+    }
+    void published(int wakeCount) {
+        seq.value.fetch_add(1, memory_order_seq_cst);
+        if (sleepers.load(memory_order_seq_cst) > 0) seq.wake(wakeCount);
+    }
+    // take() runs under m whenever the container is non-empty. The word is read
+    // under m too, so a push landing after that read always changes it.
+    template<class Take>
+    size_t waitAndTake(chrono::nanoseconds timeout, Take take) {
+        bool forever = timeout == chrono::nanoseconds::max();
+        auto deadline = chrono::steady_clock::now() + (forever ? chrono::nanoseconds(0) : timeout);
+        for (;;) {
+            uint32_t word;
+            {
+                lock_guard<mutex> lk(m);
+                if (size_t n = take()) return n;
+                word = seq.value.load(memory_order_seq_cst);
+            }
+            chrono::nanoseconds left = chrono::nanoseconds::max();
+            if (!forever) {
+                left = deadline - chrono::steady_clock::now();
+                if (left <= chrono::nanoseconds(0)) return 0;
+            }
+            sleepers.fetch_add(1, memory_order_seq_cst);
+            seq.wait(word, left);
+            sleepers.fetch_sub(1, memory_order_relaxed);
+        }
+    }
+};
+
+// ----------------- Local sockets -----------------
+// Whole-buffer send / receive on a stream socket, past EINTR and short counts (false
+// once the peer is gone), and Unix socket setup.
+#ifdef __linux__
+struct LocalSocket {
+    static bool sendAll(int fd, const void* p, size_t n) {
+        while (n) {
+            ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p = static_cast<const char*>(p) + r;
+            n -= (size_t)r;
+        }
+        return true;
+    }
+    static bool recvAll(int fd, void* p, size_t n) {
+        while (n) {
+            ssize_t r = recv(fd, p, n, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p = static_cast<char*>(p) + r;
+            n -= (size_t)r;
+        }
+        return true;
+    }
+    static int unixSocket(const string &path, sockaddr_un &addr) {
+        if (path.size() >= sizeof addr.sun_path) throw invalid_argument("socket path too long: " + path);
+        memset(&addr, 0, sizeof addr);
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw system_error(errno, generic_category(), "socket");
+        return fd;
+    }
+};
+#endif
+
+// ----------------- Replication -----------------
+// Log shipping to read-only replicas in other processes on the same machine, over a
+// Unix stream socket. The primary's container publishes into a ChangeFeed; a shipping
+// thread sends each replica that connects a snapshot, then the events after it in
+// batches (a sort or rotate stays one event). A replica applies each batch under its
+// lock in one go, mode maintenance deferred to the batch's end, and acknowledges it, so
+// both sides know the lag in events. A replica the feed has lapped, or that missed a
+// Resync, gets a fresh snapshot. Events travel as raw structs: both ends must be the
+// same build. Updates go to the primary only.
+#ifdef __linux__
+struct ReplicationFrame {
+    enum Type : uint64_t { Snapshot, Events, Ack };
+    uint64_t type;
+    uint64_t count;     // payload: snapshot words, or events
+    uint64_t seq;       // Snapshot: first event after it; Events: primary's end(); Ack: next event wanted
+};
+
+template<class DS = AdvancedDS>
+class ReplicationPrimary {
+public:
+    // Listen on path (an old socket file there is replaced) and ship q's updates from
+    // now on. Throws system_error when the socket cannot be set up.
+    ReplicationPrimary(ConcurrentAdvancedDS<DS> &q, const string &path, size_t feedCapacity = 1 << 16)
+        : q(q), path(path), feed(feedCapacity) {
+        sockaddr_un addr;
+        listenFd = LocalSocket::unixSocket(path, addr);
+        unlink(path.c_str());
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0 || listen(listenFd, 16) < 0) {
+            int e = errno;
+            close(listenFd);
+            throw system_error(e, generic_category(), "listen on " + path);
+        }
+        q.withLock([&](DS &d) { d.attachChangeFeed(&feed); });
+        shipper = thread([this] { run(); });
+    }
+    ~ReplicationPrimary() {
+        stop = true;
+        {
+            lock_guard<mutex> lk(linksM);
+            for (auto &l : links) shutdown(l->fd, SHUT_RDWR);     // unblocks a send to a stalled replica
+        }
+        shipper.join();
+        q.withLock([&](DS &d) { d.attachChangeFeed(nullptr); });
+        for (auto &l : links) close(l->fd);
+        close(listenFd);
+        unlink(path.c_str());
+    }
+    ReplicationPrimary(const ReplicationPrimary&) = delete;
+    ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+
+    // Events published so far: a replica whose applied() reaches this has every update
+    // made before the call
+    uint64_t published() const { return feed.end(); }
+    size_t replicas() const {
+        lock_guard<mutex> lk(linksM);
+        return links.size();
+    }
+    // Per connected replica, the events published that it has not acknowledged yet
+    vector<uint64_t> replicaLag() const {
+        uint64_t end = feed.end();
+        lock_guard<mutex> lk(linksM);
+        vector<uint64_t> lag;
+        for (auto &l : links) lag.push_back(end - min(end, l->acked.load(memory_order_relaxed)));
+        return lag;
+    }
+
+private:
+    static constexpr size_t BatchEvents = 4096;
+    static constexpr int IdlePollMs = 1;    // how long new events may wait to be shipped
+
+    struct Link {
+        int fd;
+        uint64_t cursor = 0;
+        bool seeded = false;
+        atomic<uint64_t> acked{0};
+        explicit Link(int fd): fd(fd) {}
+    };
+
+    ConcurrentAdvancedDS<DS> &q;
+    const string path;
+    ChangeFeed feed;
+    int listenFd;
+    atomic<bool> stop{false};
+    mutable mutex linksM;               // guards links' membership; the shipper alone uses them
+    vector<unique_ptr<Link>> links;
+    thread shipper;
+
+    void run() {
+        vector<ChangeEvent> batch(BatchEvents);
+        vector<uint64_t> words;
+        vector<pollfd> fds;
+        bool idle = false;
+        while (!stop.load(memory_order_relaxed)) {
+            fds.assign(1, {listenFd, POLLIN, 0});
+            for (auto &l : links) fds.push_back({l->fd, POLLIN, 0});
+            poll(fds.data(), fds.size(), idle ? IdlePollMs : 0);
+            idle = true;
+            vector<size_t> gone;
+            for (size_t i = 0; i < links.size(); i++)
+                if (!serve(*links[i], fds[i + 1].revents, batch, words, idle)) gone.push_back(i);
+            lock_guard<mutex> lk(linksM);
+            for (size_t k = gone.size(); k--; ) {
+                close(links[gone[k]]->fd);
+                links.erase(links.begin() + gone[k]);
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) { links.push_back(make_unique<Link>(fd)); idle = false; }
+            }
+        }
+    }
+    // Take acks, then ship what l has not seen; false once l is gone
+    bool serve(Link &l, short revents, vector<ChangeEvent> &batch, vector<uint64_t> &words, bool &idle) {
+        if (revents & POLLIN) {
+            ReplicationFrame ack;
+            if (!LocalSocket::recvAll(l.fd, &ack, sizeof ack) || ack.type != ReplicationFrame::Ack) return false;
+            l.acked.store(ack.seq, memory_order_relaxed);
+        } else if (revents & (POLLHUP | POLLERR)) {
+            return false;
+        }
+        if (!l.seeded) { l.seeded = true; idle = false; return sendSnapshot(l, words); }
+        size_t n = feed.read(l.cursor, batch.data(), batch.size());
+        if (n == 0) return true;
+        idle = false;
+        bool resync = batch[n - 1].op == ChangeOp::Resync;
+        if (resync) n--;
+        if (n) {
+            ReplicationFrame f{ReplicationFrame::Events, n, feed.end()};
+            if (!LocalSocket::sendAll(l.fd, &f, sizeof f)
+                || !LocalSocket::sendAll(l.fd, batch.data(), n * sizeof(ChangeEvent))) return false;
+        }
+        return !resync || sendSnapshot(l, words);
     }
+    bool sendSnapshot(Link &l, vector<uint64_t> &words) {
+        q.withLock([&](DS &d) {
+            d.saveSnapshot(words);
+            l.cursor = feed.end();
+        });
+        ReplicationFrame f{ReplicationFrame::Snapshot, words.size(), l.cursor};
+        return LocalSocket::sendAll(l.fd, &f, sizeof f)
+            && LocalSocket::sendAll(l.fd, words.data(), words.size() * sizeof(uint64_t));
+    }
+};
 
-    // ---------- Min/Max/Median/Mode ----------
-    int getMin() const { return allVals.empty() ? INT_MAX : *allVals.begin(); }
-    int getMax() const { return allVals.empty() ? INT_MIN : *allVals.rbegin(); }
-    double getMedian() const {
-        if (sz == 0) return numeric_limits<double>::quiet_NaN();
-        if (lower.size() > upper.size()) return *lower.rbegin();
-        return ( (double)*lower.rbegin() + (double)*upper.begin() ) / 2.0;
-        // If you prefer integer median when even, return *lower.rbegin()
+template<class DS = AdvancedDS>
+class Replica {
+public:
+    // Connect to the primary listening on path and follow it. Throws system_error
+    // when it cannot connect.
+    explicit Replica(const string &path, bool sharedReaders = false): q(sharedReaders) {
+        sockaddr_un addr;
+        fd = LocalSocket::unixSocket(path, addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+            int e = errno;
+            close(fd);
+            throw system_error(e, generic_category(), "connect to " + path);
+        }
+        follower = thread([this] { run(); });
     }
-    int getMode() const {
-        return (modeCnt == 0) ? INT_MIN : modeVal;
+    ~Replica() {
+        shutdown(fd, SHUT_RDWR);
+        follower.join();
+        close(fd);
     }
+    Replica(const Replica&) = delete;
+    Replica& operator=(const Replica&) = delete;
 
-    // ---------- Delete / Update ----------
-    // delete one occurrence of x (if exists)
-    bool deleteVal(int x) {
-        auto it = locs.find(x);
-        if (it == locs.end() || it->second.empty()) return false;
-        Node* node = *it->second.begin();
-        detach(node);
-        removeValueStructures(x, node);
-        delete node;
-        return true;
+    // f(const DS&) under the replica's lock, between two applied batches
+    template<class F>
+    decltype(auto) read(F &&f) {
+        return q.withLock([&](DS &d) -> decltype(auto) { return f(std::as_const(d)); });
     }
+    // For the lock-free walks (traverseShared / getKthShared); do not update through it
+    ConcurrentAdvancedDS<DS>& view() { return q; }
 
-    // update one occurrence of oldVal to newVal
-    bool update(int oldVal, int newVal) {
-        auto it = locs.find(oldVal);
-        if (it == locs.end() || it->second.empty()) return false;
-        Node* node = *it->second.begin();
-        // remove old tracking
-        // careful: we keep the node in place; adjust all structures
-        // remove old from all tracking
-        {
-            // locs
-            it->second.erase(node);
-            if (it->second.empty()) locs.erase(it);
-            // freq/mode
-            modeDec(oldVal);
-            // min/max
-            auto a = allVals.find(oldVal);
-            if (a != allVals.end()) allVals.erase(a);
-            // median
-            medianRemove(oldVal);
-        }
-        // set new value
-        node->val = newVal;
-        // add new tracking
-        addValueStructures(newVal, node);
-        return true;
+    // Events applied, in the primary's numbering (ReplicationPrimary::published)
+    uint64_t applied() const { return appliedSeq.load(memory_order_acquire); }
+    // Events the primary had published, as of its last batch, that are not applied yet
+    uint64_t lag() const {
+        uint64_t a = applied(), end = primaryEnd.load(memory_order_relaxed);
+        return end - min(end, a);
+    }
+    // False once the primary is gone; the contents stay readable as last applied
+    bool connected() const { return live.load(memory_order_acquire); }
+    // Block until applied() >= seq; false on timeout or disconnect
+    bool waitFor(uint64_t seq, chrono::nanoseconds timeout) {
+        unique_lock<mutex> lk(progressM);
+        return progress.wait_for(lk, timeout, [&] { return applied() >= seq || !connected(); })
+            && applied() >= seq;
     }
 
-    // ---------- Traversal / Kth ----------
-    void traverse(ostream& os = cout) const {
-        for (Node* cur = head; cur; cur = cur->next) os << cur->val << ' ';
-        os << '\n';
+private:
+    ConcurrentAdvancedDS<DS> q;
+    int fd;
+    atomic<uint64_t> appliedSeq{0}, primaryEnd{0};
+    atomic<bool> live{true};
+    mutex progressM;
+    condition_variable progress;
+    thread follower;
+
+    void run() {
+        ReplicationFrame f;
+        vector<uint64_t> words;
+        vector<ChangeEvent> events;
+        while (LocalSocket::recvAll(fd, &f, sizeof f)) {
+            uint64_t at;
+            if (f.type == ReplicationFrame::Snapshot) {
+                words.resize(f.count);
+                if (!LocalSocket::recvAll(fd, words.data(), f.count * sizeof(uint64_t))) break;
+                if (!q.withLock([&](DS &d) { return d.loadSnapshot(words.data(), words.size()); })) break;
+                at = f.seq;
+            } else if (f.type == ReplicationFrame::Events && f.count) {
+                events.resize(f.count);
+                if (!LocalSocket::recvAll(fd, events.data(), f.count * sizeof(ChangeEvent))) break;
+                q.withLock([&](DS &d) { d.applyChanges(events.data(), events.size()); });
+                at = events.back().seq + 1;
+            } else {
+                break;
+            }
+            primaryEnd.store(max(f.seq, at), memory_order_relaxed);
+            advance(at);
+            ReplicationFrame ack{ReplicationFrame::Ack, 0, at};
+            if (!LocalSocket::sendAll(fd, &ack, sizeof ack)) break;
+        }
+        lock_guard<mutex> lk(progressM);
+        live.store(false, memory_order_release);
+        progress.notify_all();
     }
-    // O(n) kth (0-indexed)
-    bool getKth(size_t k, int &out) const {
-        if (k >= sz) return false;
-        Node* cur = head;
-        while (k--) cur = cur->next;
-        out = cur->val;
-        return true;
+    void advance(uint64_t at) {
+        lock_guard<mutex> lk(progressM);
+        appliedSeq.store(at, memory_order_release);
+        progress.notify_all();
     }
+};
+#endif
 
-    // ---------- Reverse / Rotate ----------
-    // Reverse in O(n)
-    void reverse() {
-        Node* cur = head;
-        Node* prevNode = nullptr;
-        tail = head;
-        while (cur) {
-            Node* nxt = cur->next;
-            cur->next = prevNode;
-            cur->prev = nxt;
-            prevNode = cur;
-            cur = nxt;
+// ----------------- Partitioned cluster -----------------
+// Values spread over worker processes on this machine, each owning a container for
+// its partition; the coordinator talks to each over a socketpair. A value's every
+// occurrence lives in the partition its hash picks, so pushBack / deleteVal / contains
+// go to one worker and the mode is the most frequent of the workers' modes. Pushes are
+// buffered per worker and sent in batches, ahead of the next request that needs an
+// answer. Order statistics are exact, by distributed selection: each round every
+// worker reports how many of its values lie in the current window and their median,
+// the count-weighted median of those is the pivot, and the workers count what lies
+// below it. At least a quarter of the window goes each round, so a quantile costs
+// O(log n) rounds and O(n / workers) work per worker, and no values leave the workers.
+// Construct before starting other threads (workers are forked). One thread at a time.
+#ifdef __linux__
+template<class DS = AdvancedDS>
+class PartitionedCluster {
+public:
+    // Fork the workers; throws system_error when that fails, after stopping and
+    // reaping the ones already forked
+    explicit PartitionedCluster(int workers) {
+        parts.reserve(max(1, workers));     // no allocation between a fork and its push_back
+        for (int i = 0; i < max(1, workers); i++) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+                int e = errno;
+                stopWorkers();
+                throw system_error(e, generic_category(), "socketpair");
+            }
+            pid_t pid = fork();
+            if (pid < 0) {
+                int e = errno;
+                close(sv[0]);
+                close(sv[1]);
+                stopWorkers();
+                throw system_error(e, generic_category(), "fork");
+            }
+            if (pid == 0) {
+                for (Worker &w : parts) close(w.fd);
+                close(sv[0]);
+                serve(sv[1]);
+                _exit(0);
+            }
+            close(sv[1]);
+            parts.push_back({pid, sv[0], {}});
         }
-        head = prevNode;
-        // values unchanged; auxiliary structures unaffected
     }
+    ~PartitionedCluster() { stopWorkers(); }
+    PartitionedCluster(const PartitionedCluster&) = delete;
+    PartitionedCluster& operator=(const PartitionedCluster&) = delete;
 
-    // Rotate right by k (last k become first). O(n) to locate split.
-    void rotate(size_t k) {
-        if (sz == 0) return;
-        k %= sz;
-        if (k == 0) return;
-        // newTail at position sz-k-1, newHead at sz-k
-        size_t steps = sz - k - 1;
-        Node* newTail = head;
-        while (steps--) newTail = newTail->next;
-        Node* newHead = newTail->next;
+    size_t workers() const { return parts.size(); }
+    void pushBack(int x) { post(owner(x), {Push, x, 0, 0}); }
+    bool deleteVal(int x) { return call(owner(x), {Delete, x, 0, 0}).v[0]; }
+    bool contains(int x) { return call(owner(x), {Contains, x, 0, 0}).v[0]; }
+    size_t size() {
+        size_t n = 0;
+        for (const Reply &r : broadcast({Stats, 0, 0, 0})) n += (size_t)r.v[0];
+        return n;
+    }
+    int getMin() {
+        int m = INT_MAX;
+        for (const Reply &r : broadcast({Stats, 0, 0, 0})) if (r.v[0]) m = min(m, (int)r.v[1]);
+        return m;
+    }
+    int getMax() {
+        int m = INT_MIN;
+        for (const Reply &r : broadcast({Stats, 0, 0, 0})) if (r.v[0]) m = max(m, (int)r.v[2]);
+        return m;
+    }
+    // The most frequent value, the smallest on a tie, as AdvancedDS::getMode
+    int getMode() {
+        int mode = INT_MIN;
+        int64_t cnt = 0;
+        for (const Reply &r : broadcast({Stats, 0, 0, 0}))
+            if (r.v[4] > cnt || (r.v[4] == cnt && cnt && r.v[3] < mode)) { cnt = r.v[4]; mode = (int)r.v[3]; }
+        return mode;
+    }
+    double getMedian() {
+        size_t n = size();
+        if (n == 0) return numeric_limits<double>::quiet_NaN();
+        int a, b;
+        kthSmallest((n - 1) / 2, a);
+        if (n % 2) return a;
+        kthSmallest(n / 2, b);
+        return ((double)a + (double)b) / 2.0;
+    }
+    // As AdvancedDS::quantile, over the union of the partitions
+    double quantile(double q) {
+        int v;
+        return kthSmallest(DS::quantileRank(q, size()), v) ? v : numeric_limits<double>::quiet_NaN();
+    }
+    // The kth smallest (0-indexed) over all partitions; false when k >= size
+    bool kthSmallest(size_t k, int &out) {
+        int64_t lo = INT_MIN, hi = INT_MAX;
+        for (;;) {
+            // pivot: the count-weighted median of the workers' window medians
+            vector<Reply> win = broadcast({Window, (int)lo, (int)hi, 0});
+            vector<pair<int, int64_t>> meds;
+            int64_t total = 0;
+            for (const Reply &r : win) if (r.v[0]) { meds.push_back({(int)r.v[1], r.v[0]}); total += r.v[0]; }
+            if ((int64_t)k >= total) return false;
+            sort(meds.begin(), meds.end());
+            int pivot = meds.back().first;
+            int64_t acc = 0;
+            for (auto &[m, c] : meds) if ((acc += c) * 2 >= total) { pivot = m; break; }
+            int64_t less = 0, equal = 0;
+            for (const Reply &r : broadcast({Split, (int)lo, pivot, 0})) { less += r.v[0]; equal += r.v[1]; }
+            if ((int64_t)k < less) hi = (int64_t)pivot - 1;
+            else if ((int64_t)k < less + equal) { out = pivot; return true; }
+            else { k -= (size_t)(less + equal); lo = (int64_t)pivot + 1; }
+        }
+    }
 
-        // reconnect
-        newTail->next = nullptr;
-        newHead->prev = nullptr;
-        tail->next = head;
-        head->prev = tail;
+private:
+    enum Op : int32_t { Push, Delete, Contains, Stats, Window, Split, Quit };
+    struct Request {
+        int32_t op, a, b, pad;
+    };
+    // Stats: size, min, max, mode, mode count. Window [a, b]: count, median.
+    // Split [a, b): values in [a, b), occurrences of b. Delete / Contains: bool.
+    struct Reply {
+        int64_t v[5];
+    };
+    static constexpr size_t PostBatch = 512;
+    struct Worker {
+        pid_t pid;
+        int fd;
+        vector<Request> out;    // buffered, unanswered requests
+    };
+    vector<Worker> parts;
 
-        head = newHead;
-        tail = newTail;
+    // Send what is buffered and Quit, best effort: a worker that is gone already is
+    // just reaped (it also quits when its socket closes)
+    void stopWorkers() noexcept {
+        const Request quit{Quit, 0, 0, 0};
+        for (Worker &w : parts) {
+            if (LocalSocket::sendAll(w.fd, w.out.data(), w.out.size() * sizeof(Request)))
+                LocalSocket::sendAll(w.fd, &quit, sizeof quit);
+            close(w.fd);
+            waitpid(w.pid, nullptr, 0);
+        }
+        parts.clear();
+    }
+    Worker& owner(int x) {
+        uint64_t h = (uint32_t)x * 0x9E3779B97F4A7C15ull;
+        return parts[(h >> 32) * parts.size() >> 32];
+    }
+    void post(Worker &w, Request r) {
+        w.out.push_back(r);
+        if (w.out.size() >= PostBatch) flush(w);
+    }
+    void flush(Worker &w) {
+        if (!w.out.empty() && !LocalSocket::sendAll(w.fd, w.out.data(), w.out.size() * sizeof(Request)))
+            throw system_error(EPIPE, generic_category(), "cluster worker gone");
+        w.out.clear();
+    }
+    Reply receive(Worker &w) {
+        Reply r;
+        if (!LocalSocket::recvAll(w.fd, &r, sizeof r)) throw system_error(EPIPE, generic_category(), "cluster worker gone");
+        return r;
+    }
+    Reply call(Worker &w, Request r) {
+        post(w, r);
+        flush(w);
+        return receive(w);
+    }
+    // Ask every worker at once, then collect
+    vector<Reply> broadcast(Request r) {
+        for (Worker &w : parts) { post(w, r); flush(w); }
+        vector<Reply> replies;
+        for (Worker &w : parts) replies.push_back(receive(w));
+        return replies;
     }
 
-    // ---------- Random ----------
-    int getRandom() {
-        if (pool.empty()) return INT_MIN;
-        uniform_int_distribution<size_t> dist(0, pool.size()-1);
-        Node* node = pool[dist(rng)];
-        return node->val;
+    // Worker process: answer requests until the coordinator quits or goes away
+    static void serve(int fd) {
+        DS ds;
+        vector<Request> in(PostBatch);
+        vector<Reply> out;
+        size_t have = 0;    // bytes in in
+        for (;;) {
+            ssize_t r = recv(fd, reinterpret_cast<char*>(in.data()) + have, in.size() * sizeof(Request) - have, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return;
+            have += (size_t)r;
+            size_t n = have / sizeof(Request);
+            out.clear();
+            for (size_t i = 0; i < n; i++) {
+                const Request &q = in[i];
+                Reply rep{};
+                switch (q.op) {
+                case Push: ds.pushBack(q.a); continue;
+                case Delete: rep.v[0] = ds.deleteVal(q.a); break;
+                case Contains: rep.v[0] = ds.contains(q.a); break;
+                case Stats:
+                    rep = {{(int64_t)ds.size(), ds.getMin(), ds.getMax(), ds.getMode(), ds.getFrequency(ds.getMode())}};
+                    break;
+                case Window: {
+                    rep.v[0] = (int64_t)ds.countBetween(q.a, q.b);
+                    int m = 0;
+                    if (rep.v[0]) ds.kthBetween(q.a, q.b, (size_t)rep.v[0] / 2, m);
+                    rep.v[1] = m;
+                    break;
+                }
+                case Split:
+                    rep.v[0] = q.b > q.a ? (int64_t)ds.countBetween(q.a, q.b - 1) : 0;
+                    rep.v[1] = ds.getFrequency(q.b);
+                    break;
+                default:
+                    LocalSocket::sendAll(fd, out.data(), out.size() * sizeof(Reply));
+                    return;
+                }
+                out.push_back(rep);
+            }
+            if (!out.empty() && !LocalSocket::sendAll(fd, out.data(), out.size() * sizeof(Reply))) return;
+            have -= n * sizeof(Request);
+            memmove(in.data(), reinterpret_cast<char*>(in.data()) + n * sizeof(Request), have);
+        }
     }
+};
+#endif
 
-    // ---------- Unique / Remove Duplicates ----------
-    vector<int> uniqueElements() const {
-        vector<int> keys;
-        keys.reserve(freq.size());
-        for (auto &p : freq) keys.push_back(p.first);
-        return keys;
+// ----------------- External merge sort -----------------
+// Sorting more values than fit in RAM. add() collects up to runLen values, sorts them
+// in memory and writes them out as one run with a single large sequential write; finish()
+// merges the runs with a k-way loser tree (log k comparisons per value), reading each
+// run in large sequential chunks, and streams the result to out in ascending order.
+// Values that fit in one run never touch the disk. Runs go to an unlinked temp file.
+#ifdef __linux__
+// Unlinked temp file in dir, gone with its last descriptor; throws system_error
+inline int unlinkedTempFile(const string &dir) {
+    string name = dir + "/advancedds-XXXXXX";
+    int fd = mkostemp(name.data(), O_CLOEXEC);
+    if (fd < 0) throw system_error(errno, generic_category(), "temp file in " + dir);
+    unlink(name.c_str());
+    return fd;
+}
+// All n bytes at off through pread / pwrite; throws system_error
+template<class Op, class Ptr>
+void fileIO(Op op, int fd, Ptr p, size_t n, off_t off, const char* what) {
+    for (size_t done = 0; done < n; ) {
+        ssize_t r = op(fd, p + done, n - done, off + (off_t)done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) throw system_error(r < 0 ? errno : EIO, generic_category(), what);
+        done += (size_t)r;
     }
+}
 
-    // keep first occurrence order, remove later duplicates (O(n))
-    void removeDuplicates() {
-        unordered_set<int> seen;
-        for (Node* cur = head; cur; ) {
-            Node* nxt = cur->next;
-            if (seen.count(cur->val)) {
-                // remove this node
-                int x = cur->val;
-                detach(cur);
-                removeValueStructures(x, cur);
-                delete cur;
-            } else {
-                seen.insert(cur->val);
-            }
-            cur = nxt;
+class ExternalSorter {
+public:
+    struct Stats {
+        size_t runs = 0;
+        uint64_t bytesWritten = 0, bytesRead = 0;
+        double runSeconds = 0;      // sorting runs and writing them
+        double mergeSeconds = 0;    // reading and merging them
+        double mbPerSecond() const {
+            double t = runSeconds + mergeSeconds;
+            return t > 0 ? (double)(bytesWritten + bytesRead) / 1e6 / t : 0;
+        }
+    };
+
+    // RAM: runLen values while forming runs, about as much for read buffers when merging
+    explicit ExternalSorter(const string &dir = "/tmp", size_t runLen = 1 << 22)
+        : dir(dir), runLen(max<size_t>(runLen, 1024)) { run.reserve(this->runLen); }
+    ~ExternalSorter() { if (fd >= 0) close(fd); }
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(int x) {
+        run.push_back(x);
+        if (run.size() == runLen) writeRun();
+    }
+    // out(v) for every value added, ascending. Once.
+    template<class Out>
+    void finish(Out &&out) {
+        if (runs.empty()) {             // it all fit
+            sort(run.begin(), run.end());
+            for (int x : run) out(x);
+            run.clear();
+            return;
         }
+        if (!run.empty()) writeRun();
+        auto t0 = chrono::steady_clock::now();
+        size_t k = runs.size();
+        size_t chunk = max<size_t>(runLen / k, 16 * 1024);   // values per read
+        vector<Cursor> cur(k);
+        for (size_t i = 0; i < k; i++) {
+            cur[i].off = runs[i].first;
+            cur[i].end = runs[i].second;
+            cur[i].buf.resize(chunk);
+            refill(cur[i]);
+        }
+        // loser tree: tree[0] holds the winner, tree[1..k) the loser of each match
+        auto beats = [&](size_t a, size_t b) {
+            if (cur[a].done() || cur[b].done()) return !cur[a].done();
+            return cur[a].head() < cur[b].head() || (cur[a].head() == cur[b].head() && a < b);
+        };
+        vector<size_t> tree(k), win(2 * k);
+        for (size_t i = 0; i < k; i++) win[k + i] = i;
+        for (size_t n = k - 1; n >= 1; n--) {
+            size_t a = win[2 * n], b = win[2 * n + 1];
+            win[n] = beats(a, b) ? a : b;
+            tree[n] = beats(a, b) ? b : a;
+        }
+        tree[0] = k > 1 ? win[1] : 0;
+        for (;;) {
+            size_t w = tree[0];
+            if (cur[w].done()) break;
+            out(cur[w].head());
+            if (++cur[w].pos == cur[w].len) refill(cur[w]);
+            for (size_t n = (w + k) / 2; n >= 1; n /= 2)
+                if (beats(tree[n], w)) std::swap(tree[n], w);
+            tree[0] = w;
+        }
+        runs.clear();
+        st.mergeSeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
     }
+    const Stats& stats() const { return st; }
 
-    // ---------- Sorting / Permutations ----------
-    void sortAscending() {
-        if (sz <= 1) return;
-        vector<int> a; a.reserve(sz);
-        for (Node* cur = head; cur; cur = cur->next) a.push_back(cur->val);
-        sort(a.begin(), a.end());
-        // write back
-        Node* cur = head; size_t i = 0;
-        while (cur) { cur->val = a[i++]; cur = cur->next; }
-        rebuildAll();
+private:
+    struct Cursor {
+        vector<int> buf;
+        size_t pos = 0, len = 0;
+        uint64_t off = 0, end = 0;      // unread byte range of the run
+        bool done() const { return pos == len; }
+        int head() const { return buf[pos]; }
+    };
+    const string dir;
+    const size_t runLen;
+    vector<int> run;
+    vector<pair<uint64_t, uint64_t>> runs;      // byte ranges in the file
+    int fd = -1;
+    uint64_t fileEnd = 0;
+    Stats st;
+
+    void writeRun() {
+        auto t0 = chrono::steady_clock::now();
+        if (fd < 0) fd = unlinkedTempFile(dir);
+        sort(run.begin(), run.end());
+        size_t bytes = run.size() * sizeof(int);
+        fileIO(pwrite, fd, reinterpret_cast<const char*>(run.data()), bytes, (off_t)fileEnd, "write run");
+        runs.push_back({fileEnd, fileEnd + bytes});
+        fileEnd += bytes;
+        st.runs++;
+        st.bytesWritten += bytes;
+        run.clear();
+        st.runSeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
     }
-    void sortDescending() {
-        if (sz <= 1) return;
-        vector<int> a; a.reserve(sz);
-        for (Node* cur = head; cur; cur = cur->next) a.push_back(cur->val);
-        sort(a.rbegin(), a.rend());
-        Node* cur = head; size_t i = 0;
-        while (cur) { cur->val = a[i++]; cur = cur->next; }
-        rebuildAll();
+    void refill(Cursor &c) {
+        size_t bytes = (size_t)min<uint64_t>(c.buf.size() * sizeof(int), c.end - c.off);
+        if (bytes) fileIO(pread, fd, reinterpret_cast<char*>(c.buf.data()), bytes, (off_t)c.off, "read run");
+        c.off += bytes;
+        c.pos = 0;
+        c.len = bytes / sizeof(int);
+        st.bytesRead += bytes;
     }
+};
+#endif
 
-    bool nextPermutation() {
-        if (sz <= 1) return false;
-        vector<int> a; a.reserve(sz);
-        for (Node* cur = head; cur; cur = cur->next) a.push_back(cur->val);
-        bool ok = std::next_permutation(a.begin(), a.end());
-        Node* cur = head; size_t i = 0;
-        while (cur) { cur->val = a[i++]; cur = cur->next; }
-        rebuildAll();
-        return ok;
+// ----------------- Spilling queue -----------------
+// A queue far larger than RAM, hot only at its ends. The front and back are in-memory
+// containers of up to two segments each; the middle lives in a segment file as
+// fixed-size segments, each held in RAM only as a summary (file slot, min, max).
+// Overflow at an end moves one segment's worth to the file (or straight to the other
+// end while the middle is empty); when an end runs down to a quarter segment, the
+// neighbouring segment is paged back in ahead of the pops that need it. RAM is bounded
+// by the segment length and the per-segment summaries; every push and pop is O(1)
+// amortized I/O plus O(log segment) index work. getMin / getMax are exact over the
+// whole queue from the summaries and mean from a running sum; median and mode are not
+// kept for the spilled part.
+// sortAscending sorts it all through ExternalSorter, in bounded RAM.
+// The file is unlinked at once and freed slots are reused and hole-punched; where the
+// filesystem cannot punch holes it keeps its high-water size (fileBytes() shows it)
+// until the middle empties, when it is truncated.
+#ifdef __linux__
+template<class DS = RealTimeAdvancedDS>     // no mode rescans on the pops
+class SpillingQueue {
+public:
+    // The segment file goes in dir; throws system_error when it cannot be created
+    explicit SpillingQueue(const string &dir = "/tmp", size_t segmentLen = 1 << 16)
+        : dir(dir), segLen(max<size_t>(segmentLen, 16)), buf(segLen), fd(unlinkedTempFile(dir)) {}
+    ~SpillingQueue() { close(fd); }
+    SpillingQueue(const SpillingQueue&) = delete;
+    SpillingQueue& operator=(const SpillingQueue&) = delete;
+
+    bool empty() const { return size() == 0; }
+    size_t size() const { return head.size() + segs.size() * segLen + tail.size(); }
+    size_t spilledSegments() const { return segs.size(); }
+    uint64_t bytesWritten() const { return written; }
+    uint64_t bytesRead() const { return readBytes; }
+    // Bytes the segment file occupies on disk, at most
+    uint64_t fileBytes() const { return (slots - (punchHoles ? freeSlots.size() : 0)) * segBytes(); }
+
+    // An end that is empty implies an empty middle, so the other end then holds it all
+    int front() const { return head.empty() ? tail.front() : head.front(); }
+    int back() const { return tail.empty() ? head.back() : tail.back(); }
+    void pushBack(int x) {
+        tail.pushBack(x);
+        sum += x;
+        if (tail.size() >= 2 * segLen) spillBack();
     }
-    bool prevPermutation() {
-        if (sz <= 1) return false;
-        vector<int> a; a.reserve(sz);
-        for (Node* cur = head; cur; cur = cur->next) a.push_back(cur->val);
-        bool ok = std::prev_permutation(a.begin(), a.end());
-        Node* cur = head; size_t i = 0;
-        while (cur) { cur->val = a[i++]; cur = cur->next; }
-        rebuildAll();
-        return ok;
+    void pushFront(int x) {
+        head.pushFront(x);
+        sum += x;
+        if (head.size() >= 2 * segLen) spillFront();
+    }
+    void popFront() {
+        if (empty()) return;
+        DS &from = head.empty() ? tail : head;
+        sum -= from.front();
+        from.popFront();
+        if (head.size() <= segLen / 4 && !segs.empty()) pageInFront();
+    }
+    void popBack() {
+        if (empty()) return;
+        DS &from = tail.empty() ? head : tail;
+        sum -= from.back();
+        from.popBack();
+        if (tail.size() <= segLen / 4 && !segs.empty()) pageInBack();
     }
 
-    // ---------- Merge / Split / Clear ----------
-    // Append all from other to this (other becomes empty). O(n_other)
-    void merge(AdvancedDS &other) {
-        if (other.sz == 0) return;
-        if (sz == 0) {
-            head = other.head;
-            tail = other.tail;
-        } else {
-            tail->next = other.head;
-            other.head->prev = tail;
-            tail = other.tail;
-        }
-        sz += other.sz;
-        // integrate aux structures efficiently by traversing other's list:
-        for (Node* cur = other.head; cur; cur = cur->next) {
-            locs[cur->val].insert(cur);
-            modeInc(cur->val);
-            allVals.insert(cur->val);
-            medianAdd(cur->val);
-            poolAdd(cur);
-        }
-        // clear "other"
-        other.head = other.tail = nullptr;
-        other.sz = 0;
-        other.locs.clear();
-        other.freq.clear();
-        other.allVals.clear();
-        other.lower.clear();
-        other.upper.clear();
-        other.pool.clear();
-        other.poolPos.clear();
-        other.modeCnt = 0;
-        other.modeVal = 0;
-        rebalanceMedian();
+    int getMin() const {
+        int m = min(head.getMin(), tail.getMin());
+        return segMins.empty() ? m : min(m, *segMins.begin());
+    }
+    int getMax() const {
+        int m = max(head.getMax(), tail.getMax());
+        return segMaxs.empty() ? m : max(m, *segMaxs.rbegin());
     }
+    double mean() const { return empty() ? numeric_limits<double>::quiet_NaN() : (double)sum / (double)size(); }
 
-    // Split after k nodes (left keeps first k, right gets the rest)
-    AdvancedDS split(size_t k) {
-        AdvancedDS right;
-        if (k >= sz) return right;
-        if (k == 0) {
-            right.merge(*this);
-            return right;
+    // Sort the whole queue with ExternalSorter (runs of runLen values), the result
+    // written straight back as segments. RAM: about runLen values; disk: the old
+    // segments stay until the sorted ones are all written, so an I/O error (thrown)
+    // leaves the queue unsorted but whole. Returns the sort's I/O figures; the segment
+    // traffic shows in bytesWritten / bytesRead.
+    ExternalSorter::Stats sortAscending(size_t runLen = 1 << 22) {
+        ExternalSorter sorter(dir, runLen);
+        auto add = [&](int x) { sorter.add(x); };
+        head.forEach(add);
+        for (const Segment &s : segs) {
+            read(s);
+            for (int x : buf) sorter.add(x);
         }
-        Node* cur = head;
-        size_t cnt = k-1;
-        while (cnt--) cur = cur->next;
-        Node* newHead = cur->next;
+        tail.forEach(add);
+        deque<Segment> sorted;
+        size_t n = 0;
+        try {
+            sorter.finish([&](int x) {
+                buf[n++] = x;
+                if (n == segLen) { sorted.push_back(store()); n = 0; }
+            });
+        } catch (...) {
+            for (const Segment &s : sorted) release(s);
+            throw;
+        }
+        for (const Segment &s : segs) release(s);
+        segs.swap(sorted);
+        if (segs.empty()) truncate();
+        head.clear();
+        tail.clear();
+        for (size_t i = 0; i < n; i++) tail.pushBack(buf[i]);
+        if (!segs.empty()) pageInFront();
+        if (tail.size() <= segLen / 4 && !segs.empty()) pageInBack();
+        return sorter.stats();
+    }
 
-        // detach
-        cur->next = nullptr;
-        if (newHead) newHead->prev = nullptr;
+private:
+    struct Segment {
+        size_t slot;
+        int min, max;
+    };
+    const string dir;
+    const size_t segLen;
+    vector<int> buf;                // one segment, staged for I/O
+    int fd;
+    DS head, tail;                  // head ++ segs ++ tail is the queue
+    deque<Segment> segs;
+    PoolMultiset segMins, segMaxs;
+    vector<size_t> freeSlots;
+    size_t slots = 0;
+    bool punchHoles = true;         // until the filesystem refuses
+    __int128 sum = 0;               // billions of spilled ints overflow 64 bits
+    uint64_t written = 0, readBytes = 0;
 
-        // right takes newHead..tail
-        right.head = newHead;
-        right.tail = tail;
+    size_t segBytes() const { return segLen * sizeof(int); }
 
-        // this keeps head..cur
-        tail = cur;
+    // tail's oldest segment goes to the middle, or to head while there is no middle.
+    // Written before it is popped: a failed write throws with nothing lost, the push
+    // that triggered it kept in RAM, and the next push tries again.
+    void spillBack() {
+        if (segs.empty() && head.size() < segLen) {
+            for (size_t i = 0; i < segLen; i++) { head.pushBack(tail.front()); tail.popFront(); }
+            return;
+        }
+        for (size_t i = 0; i < segLen; i++) tail.getKth(i, buf[i]);    // sequential: O(1) each
+        segs.push_back(store());
+        for (size_t i = 0; i < segLen; i++) tail.popFront();
+    }
+    void spillFront() {
+        if (segs.empty() && tail.size() < segLen) {
+            for (size_t i = 0; i < segLen; i++) { tail.pushFront(head.back()); head.popBack(); }
+            return;
+        }
+        for (size_t i = 0, base = head.size() - segLen; i < segLen; i++) head.getKth(base + i, buf[i]);
+        segs.push_front(store());
+        for (size_t i = 0; i < segLen; i++) head.popBack();
+    }
+    void pageInFront() {
+        load(segs.front());
+        segs.pop_front();
+        for (int x : buf) head.pushBack(x);
+        if (segs.empty()) truncate();
+    }
+    void pageInBack() {
+        load(segs.back());
+        segs.pop_back();
+        for (size_t i = segLen; i--; ) tail.pushFront(buf[i]);
+        if (segs.empty()) truncate();
+    }
 
-        // recompute both structures
-        size_t oldSz = sz;
-        // recompute sizes by traversal (O(n))
-        sz = 0;
-        for (Node* p = head; p; p = p->next) sz++;
-        right.sz = 0;
-        for (Node* p = right.head; p; p = p->next) right.sz++;
+    // Write buf to a free slot and summarize it; the slot is taken once the write succeeded
+    Segment store() {
+        Segment s{freeSlots.empty() ? slots : freeSlots.back(), buf[0], buf[0]};
+        for (int x : buf) { s.min = min(s.min, x); s.max = max(s.max, x); }
+        fileIO(pwrite, fd, reinterpret_cast<const char*>(buf.data()), segBytes(), (off_t)(s.slot * segBytes()), "write segment");
+        if (!freeSlots.empty()) freeSlots.pop_back(); else slots++;
+        written += segBytes();
+        segMins.insert(s.min);
+        segMaxs.insert(s.max);
+        return s;
+    }
+    void load(const Segment &s) {
+        read(s);
+        release(s);
+    }
+    void read(const Segment &s) {
+        fileIO(pread, fd, reinterpret_cast<char*>(buf.data()), segBytes(), (off_t)(s.slot * segBytes()), "read segment");
+        readBytes += segBytes();
+    }
+    // Drop the segment's summary and punch out its slot for reuse. A failed punch loses
+    // nothing but disk: the slot is reused all the same, so stop trying
+    void release(const Segment &s) {
+        segMins.erase(segMins.find(s.min));
+        segMaxs.erase(segMaxs.find(s.max));
+        if (punchHoles && fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                    (off_t)(s.slot * segBytes()), (off_t)segBytes()) != 0)
+            punchHoles = false;
+        freeSlots.push_back(s.slot);
+    }
+    // No segment left: hand the whole file back, holes or not (kept as is if that fails)
+    void truncate() {
+        if (ftruncate(fd, 0) != 0) return;
+        slots = 0;
+        freeSlots.clear();
+    }
+};
+#endif
 
-        // rebuild aux structures (simpler & safe)
-        rebuildAll();
-        right.rebuildAll();
+// ----------------- Profiling hooks -----------------
+// Hardware counters bracketing a batch of operations (Linux perf_event_open).
+// Counters are opened with inherit=1, so threads spawned inside the batch count too.
+// A counter that cannot be opened (no PMU, perf_event_paranoid, containers) reads -1;
+// wall time is always available.
+class PerfCounters {
+public:
+    enum Event { Instructions, Cycles, CacheMisses, BranchMisses, NumEvents };
+    struct Sample {
+        double ns = 0;
+        long long v[NumEvents] = {-1, -1, -1, -1};
+    };
 
-        return right;
+    PerfCounters() {
+#ifdef __linux__
+        static const pair<uint32_t, uint64_t> cfg[NumEvents] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (int i = 0; i < NumEvents; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = cfg[i].first;
+            attr.config = cfg[i].second;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
     }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int f : fd) if (f >= 0) close(f);
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
 
-    void clear() {
-        Node* cur = head;
-        while (cur) {
-            Node* nxt = cur->next;
-            delete cur;
-            cur = nxt;
+    bool available(Event e) const { return fd[e] >= 0; }
+
+    void start() {
+#ifdef __linux__
+        for (int f : fd) if (f >= 0) { ioctl(f, PERF_EVENT_IOC_RESET, 0); ioctl(f, PERF_EVENT_IOC_ENABLE, 0); }
+#endif
+        t0 = chrono::steady_clock::now();
+    }
+    Sample stop() {
+        Sample s;
+        auto t1 = chrono::steady_clock::now();
+#ifdef __linux__
+        for (int i = 0; i < NumEvents; i++) {
+            if (fd[i] < 0) continue;
+            ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            long long c = 0;
+            if (read(fd[i], &c, sizeof c) == (ssize_t)sizeof c) s.v[i] = c;
         }
-        head = tail = nullptr;
-        sz = 0;
-        locs.clear();
-        freq.clear();
-        allVals.clear();
-        lower.clear();
-        upper.clear();
-        pool.clear();
-        poolPos.clear();
-        modeCnt = 0;
-        modeVal = 0;
+#endif
+        s.ns = (double)chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+        return s;
     }
+
+private:
+    int fd[NumEvents] = {-1, -1, -1, -1};
+    chrono::steady_clock::time_point t0;
 };
 
+// Run body() once as a batch of `ops` operations and print per-op figures:
+//   label  ns/op  instr/op  IPC  cache-miss/op  branch-miss/op
+template<class F>
+PerfCounters::Sample benchBatch(const char* label, size_t ops, F&& body, ostream& os = cout) {
+    static PerfCounters pc;
+    pc.start();
+    body();
+    PerfCounters::Sample s = pc.stop();
+    double n = ops ? (double)ops : 1.0;
+    auto perOp = [&](int e) -> string {
+        if (s.v[e] < 0) return "n/a";
+        ostringstream o; o << fixed << setprecision(2) << s.v[e] / n; return o.str();
+    };
+    string ipc = "n/a";
+    if (s.v[PerfCounters::Instructions] >= 0 && s.v[PerfCounters::Cycles] > 0) {
+        ostringstream o;
+        o << fixed << setprecision(2) << (double)s.v[PerfCounters::Instructions] / s.v[PerfCounters::Cycles];
+        ipc = o.str();
+    }
+    os << left << setw(28) << label << right
+       << setw(12) << fixed << setprecision(2) << s.ns / n << " ns/op"
+       << setw(12) << perOp(PerfCounters::Instructions) << " instr"
+       << setw(8) << ipc << " IPC"
+       << setw(10) << perOp(PerfCounters::CacheMisses) << " cmiss"
+       << setw(10) << perOp(PerfCounters::BranchMisses) << " bmiss" << '\n';
+    return s;
+}
+
 // ----------------- Example usage -----------------
 /*
 int main() {
@@ -534,7 +3838,8 @@ int main() {
     ds.nextPermutation();
     ds.traverse();                 // 1 2 5 3
 
-    cout << "Random: " << ds.getRandom() << "\n";
+    ds.seed(42);
+    cout << "Random: " << ds.getRandom() << "\n";   // same value on every run
 
     ds.deleteVal(2);
     ds.traverse();                 // 1 5 3
@@ -553,5 +3858,480 @@ int main() {
     AdvancedDS right = ds.split(2);
     cout << "Left: "; ds.traverse();      // 3 1
     cout << "Right: "; right.traverse();  // 7
+
+    auto st = ds.pushAndSummarize<AdvancedDS::SumMin | AdvancedDS::SumMedian>(4, 2);
+    cout << "Window min " << st.min << " median " << st.median << "\n";  // 7 4 -> 4, 5.5
+
+    PartitionedCluster<> cluster(4);        // four worker processes, forked before any threads
+    for (int v = 1; v <= 9; v++) cluster.pushBack(v * 10);
+    cout << "Cluster median " << cluster.getMedian() << " p90 " << cluster.quantile(0.9) << '\n';   // 50 80
+
+    SpillingQueue<> backlog("/tmp", 1024);  // the middle goes to disk in segments of 1024
+    for (int i = 0; i < 100000; i++) backlog.pushBack(i * 7919 % 100000);
+    cout << "Backlog " << backlog.size() << ", " << backlog.spilledSegments() << " segments on disk, max "
+         << backlog.getMax() << '\n';     // 100000, 95 segments on disk, max 99999
+    ExternalSorter::Stats io = backlog.sortAscending(1 << 14);     // runs of 16K values
+    cout << "Sorted " << backlog.front() << ".." << backlog.back() << " through " << io.runs << " runs, "
+         << io.bytesWritten + io.bytesRead << " bytes of run I/O\n";   // 0..99999, 7 runs, 800000 bytes
+
+    RealTimeAdvancedDS recent;
+    recent.setMemoryBudget(1 << 20);        // over 1MB, the oldest go
+    for (int i = 0; i < 100000; i++) recent.pushBack(i);
+    cout << "Budget kept " << recent.size() << " from " << recent.front() << ", "
+         << recent.memoryUsed() << " bytes\n";    // 3848 from 96152, 993536 bytes
+
+    AdvancedDS temps;
+    temps.subscribeCrossing(AdvancedDS::SumMedian, 500, [](double m, bool rising) {
+        cout << "Median " << (rising ? "rose to " : "fell to ") << m << '\n';
+    });
+    for (int t : {420, 480, 610, 650}) temps.pushBack(t);   // Median rose to 545
+
+    AdvancedDS sessions;
+    sessions.pushBack(1, 30);
+    sessions.pushBack(2, 10);
+    sessions.pushBack(3);                   // never expires
+    size_t gone = sessions.expire(15);      // removes 2
+    cout << "Expired " << gone << ", left: ";
+    sessions.traverse();                    // 1 3
+
+    ConcurrentAdvancedDS<> jobs;
+    thread producer([&] {
+        int batch[] = {1, 2, 3};
+        jobs.pushBackMany(begin(batch), end(batch));
+    });
+    vector<int> got;
+    jobs.popFrontBatch(8, got);             // sleeps until the batch lands: 1 2 3
+    producer.join();
+    cout << "Batch of " << got.size() << '\n';
+
+    ConcurrentAdvancedDS<> board(true);     // sharedReaders: walks take no lock
+    int scores[] = {5, 8, 13};
+    board.pushBackMany(begin(scores), end(scores));
+    vector<int> snap;
+    board.traverseShared(snap);             // 5 8 13, while writers carry on
+    int second;
+    if (board.getKthShared(1, second)) cout << "Second score " << second << '\n';   // 8
+
+    AdvancedDS primary, mirror;
+    ChangeFeed feed;
+    primary.attachChangeFeed(&feed);
+    uint64_t cursor = feed.end();           // both empty: nothing to copy first
+    for (int v : {7, 3, 9, 3}) primary.pushBack(v);
+    primary.sortAscending();                // one event, replayed by the mirror
+    ChangeEvent batch[64];
+    for (size_t n; (n = feed.read(cursor, batch, 64)); )
+        for (size_t i = 0; i < n; i++)
+            if (!mirror.applyChange(batch[i])) { mirror.assignFrom(primary); cursor = feed.end(); }
+    cout << "Mirror: ";
+    mirror.traverse();                      // 3 3 7 9
+
+    ConcurrentAdvancedDS<> orders;
+    ReplicationPrimary<> origin(orders, "/tmp/advancedds-example.sock");
+    Replica<> replica("/tmp/advancedds-example.sock");     // normally in another process
+    for (int v : {30, 10, 20}) orders.pushBack(v);
+    if (replica.waitFor(origin.published(), chrono::seconds(1)))
+        cout << "Replica median " << replica.read([](const AdvancedDS &d) { return d.getMedian(); }) << '\n';   // 20
+#ifdef __cpp_impl_coroutine
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            suspend_never initial_suspend() { return {}; }
+            suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { terminate(); }
+        };
+    };
+    auto consumer = [](ConcurrentAdvancedDS<> &q) -> Detached {
+        int v = co_await q.popFrontAsync();   // suspends: nothing queued yet
+        cout << "Awaited " << v << '\n';
+    };
+    consumer(jobs);
+    jobs.pushBack(42);                      // resumes the consumer right here
+#endif
+}
+*/
+
+// Time every call op(i), i in [0, ops), individually and print the latency tail:
+//   label  p50  p99  p99.99  max   (nanoseconds)
+template<class F>
+vector<uint64_t> benchLatency(const char* label, size_t ops, F&& op, ostream& os = cout) {
+    vector<uint64_t> lat(ops);
+    for (size_t i = 0; i < ops; i++) {
+        auto t0 = chrono::steady_clock::now();
+        op(i);
+        auto t1 = chrono::steady_clock::now();
+        lat[i] = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+    }
+    vector<uint64_t> sorted = lat;
+    sort(sorted.begin(), sorted.end());
+    auto pct = [&](double q) { return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, (size_t)(q * sorted.size()))]; };
+    os << left << setw(28) << label << right
+       << " p50 " << setw(8) << pct(0.50) << " p99 " << setw(8) << pct(0.99)
+       << " p99.99 " << setw(10) << pct(0.9999) << " max " << setw(12) << (sorted.empty() ? 0 : sorted.back())
+       << " ns\n";
+    return lat;
+}
+
+// ----------------- Benchmark -----------------
+/*
+int main() {
+    const int N = 1 << 16;
+    AdvancedDS ds(1);                             // seeded: same getRandom draws every run
+    vector<int> arr;                              // contiguous layout, same contents
+    for (int i = 0; i < N; i++) { ds.pushBack(i * 7919 % N); arr.push_back(i * 7919 % N); }
+
+    long long sink = 0;
+    const size_t Q = 2000;
+    benchBatch("getKth (linked list)", Q, [&] {
+        int v = 0;
+        for (size_t i = 0; i < Q; i++) { ds.getKth(i * 31 % N, v); sink += v; }
+    });
+    benchBatch("kth (vector)", Q, [&] {
+        for (size_t i = 0; i < Q; i++) sink += arr[i * 31 % N];
+    });
+    benchBatch("getKth sequential (finger)", N, [&] {
+        int v = 0;
+        for (int i = 0; i < N; i++) { ds.getKth(i, v); sink += v; }
+    });
+    benchBatch("pushBack+popFront", N, [&] {
+        for (int i = 0; i < N; i++) { ds.pushBack(i); ds.popFront(); }
+    });
+    {
+        // cost of a median subscriber on a sliding window (RealTime: no mode rescans)
+        RealTimeAdvancedDS win;
+        for (int i = 0; i < N; i++) win.pushBack(i);
+        for (bool watched : {false, true}) {
+            uint64_t id = watched ? win.subscribe(RealTimeAdvancedDS::SumMedian,
+                [&](const RealTimeAdvancedDS::Summary &, const RealTimeAdvancedDS::Summary &a, unsigned) {
+                    sink += (long long)a.median;
+                }) : 0;
+            benchBatch(watched ? "window push+pop (watched)" : "window push+pop", N, [&] {
+                for (int i = 0; i < N; i++) { win.pushBack(N + i); win.popFront(); }
+            });
+            win.unsubscribe(id);
+        }
+    }
+    // alternating low/high values force a median rebalance on every insert
+    benchBatch("median: alternating push", N, [&] {
+        for (int i = 0; i < N; i++) ds.pushBack(i & 1 ? N + i : -i);
+    });
+    benchBatch("median: sliding window", N, [&] {
+        for (int i = 0; i < N; i++) ds.pushAndSummarize<AdvancedDS::SumMedian>(i & 1 ? N + i : -i, N);
+    });
+    benchBatch("getMedian", N, [&] {
+        for (int i = 0; i < N; i++) sink += (long long)ds.getMedian();
+    });
+    benchBatch("contains", N, [&] {
+        for (int i = 0; i < N; i++) sink += ds.contains(i);
+    });
+    {
+        // membership batches against a value index far larger than the cache
+        AdvancedDS wide;
+        for (int i = 0; i < (1 << 22); i++) wide.pushBack(i * 2);
+        vector<int> keys(N);
+        for (int i = 0; i < N; i++) keys[i] = (int)((i * 2654435761u) % (1u << 23));
+        unique_ptr<bool[]> hits(new bool[N]);
+        benchBatch("contains loop (4M distinct)", N, [&] {
+            for (int i = 0; i < N; i++) sink += wide.contains(keys[i]);
+        });
+        benchBatch("containsMany (4M distinct)", N, [&] {
+            wide.containsMany(keys.data(), N, hits.get());
+            for (int i = 0; i < N; i++) sink += hits[i];
+        });
+    }
+    {
+        // short-lived timed items among a large untimed population
+        AdvancedDS live;
+        for (int i = 0; i < N; i++) live.pushBack(i);
+        uint64_t now = 0;
+        benchBatch("pushBack(x, ttl) + expire", N, [&] {
+            for (int i = 0; i < N; i++) { live.pushBack(N + i, 1 + i % 97); sink += live.expire(++now); }
+        });
+    }
+    cout << "(checksum " << sink << ")\n";
+
+    // latency tail of a feed-handler style mix: pushes, some pops, a periodic clear().
+    // RealTime's median and p99 are higher; its max has no clear() in it
+    auto feed = [](auto &q, size_t i) {
+        q.pushBack((int)(i * 2654435761u % 100000));
+        if (i % 4 == 0) q.popFront();
+        if (i % 300000 == 299999) q.clear();
+    };
+    AdvancedDS plain;
+    RealTimeAdvancedDS rt;
+    SmallPool::setCacheLimit(SIZE_MAX);
+    benchLatency("feed mix (default)", 1 << 21, [&](size_t i) { feed(plain, i); });
+    benchLatency("feed mix (RealTime)", 1 << 21, [&](size_t i) { feed(rt, i); });
+
+    // 4 worker processes: batched pushes, then an exact median by distributed selection
+    // against one container doing the same. Ahead of anything that starts a thread:
+    // the workers are forked.
+    {
+        PartitionedCluster<> cluster(4);
+        AdvancedDS local;
+        mt19937 vals(9);
+        auto t0 = chrono::steady_clock::now();
+        for (int i = 0; i < N; i++) cluster.pushBack((int)vals());
+        double m = cluster.getMedian();
+        auto t1 = chrono::steady_clock::now();
+        vals.seed(9);
+        for (int i = 0; i < N; i++) local.pushBack((int)vals());
+        double ml = local.getMedian();
+        auto t2 = chrono::steady_clock::now();
+        cout << left << setw(28) << "cluster: push + median" << right << " "
+             << chrono::duration<double, milli>(t1 - t0).count() << " ms (one container "
+             << chrono::duration<double, milli>(t2 - t1).count() << " ms), "
+             << (m == ml ? "same median\n" : "MEDIAN DIFFERS\n");
+    }
+
+    // caller-side cost of dropping a large container, synchronous vs deferred
+    for (bool defer : {false, true}) {
+        auto big = make_unique<AdvancedDS>();
+        big->setDeferredReclaim(defer);
+        for (int i = 0; i < 4 * N * 16; i++) big->pushBack(i % 100003);
+        auto t0 = chrono::steady_clock::now();
+        big.reset();
+        auto t1 = chrono::steady_clock::now();
+        cout << left << setw(28) << (defer ? "destroy 4M (deferred)" : "destroy 4M (inline)") << right
+             << " " << chrono::duration<double, milli>(t1 - t0).count() << " ms\n";
+    }
+    BackgroundReclaimer::instance().wait();
+
+    // task scheduling: each worker owns a queue and pushes/pops at its back; idle
+    // workers steal from a random victim's front. Tasks of depth d > 0 spawn two of
+    // depth d - 1. Mutex-guarded AdvancedDS queues vs WorkStealingDeque.
+    {
+        const int W = (int)max(2u, thread::hardware_concurrency()), Depth = 12, Roots = 64;
+        const long total = (long)Roots * ((2 << Depth) - 1);
+        auto schedule = [&](const char* label, auto &queues, auto push, auto pop, auto steal) {
+            atomic<long> pending{total};
+            auto t0 = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (int w = 0; w < W; w++) workers.emplace_back([&, w] {
+                if (w == 0) for (int r = 0; r < Roots; r++) push(queues[0], Depth);
+                mt19937 pick(w);
+                int d;
+                while (pending.load(memory_order_relaxed) > 0) {
+                    if (!pop(queues[w], d) && !steal(queues[pick() % W], d)) continue;
+                    if (d > 0) { push(queues[w], d - 1); push(queues[w], d - 1); }
+                    else { volatile int spin = 0; for (int i = 0; i < 200; i++) spin = spin + i; }
+                    pending.fetch_sub(1, memory_order_relaxed);
+                }
+            });
+            for (auto &t : workers) t.join();
+            cout << left << setw(28) << label << right << " "
+                 << chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() << " ms\n";
+        };
+        struct Locked { mutex m; AdvancedDS q; };
+        vector<Locked> locked(W);
+        schedule("tasks: mutex + AdvancedDS", locked,
+            [](Locked &l, int d) { lock_guard<mutex> g(l.m); l.q.pushBack(d); },
+            [](Locked &l, int &d) {
+                lock_guard<mutex> g(l.m);
+                if (l.q.empty()) return false;
+                d = l.q.back(); l.q.popBack(); return true;
+            },
+            [](Locked &l, int &d) {
+                lock_guard<mutex> g(l.m);
+                if (l.q.empty()) return false;
+                d = l.q.front(); l.q.popFront(); return true;
+            });
+        vector<WorkStealingDeque<int>> deques(W);
+        schedule("tasks: Chase-Lev", deques,
+            [](WorkStealingDeque<int> &q, int d) { q.pushBack(d); },
+            [](WorkStealingDeque<int> &q, int &d) { return q.popBack(d); },
+            [](WorkStealingDeque<int> &q, int &d) { return q.stealFront(d); });
+    }
+
+    // writer latency while a reader per spare core keeps walking a 64K list:
+    // through the mutex vs lock-free with epoch-based reclamation
+    for (bool shared : {false, true}) {
+        ConcurrentAdvancedDS<> q(shared);
+        for (int i = 0; i < N; i++) q.pushBack(i);
+        atomic<bool> stop{false};
+        vector<thread> readers;
+        for (int r = 0, R = max(1, (int)thread::hardware_concurrency() - 1); r < R; r++) readers.emplace_back([&] {
+            vector<int> v;
+            while (!stop.load(memory_order_relaxed)) q.traverseShared(v);
+        });
+        benchLatency(shared ? "writer, lock-free readers" : "writer, locked readers", 1 << 14, [&](size_t i) {
+            q.withLock([&](AdvancedDS &d) { d.pushBack((int)i); d.popFront(); });
+        });
+        stop = true;
+        for (auto &t : readers) t.join();
+    }
+
+    // keeping a mirror of a 64K list in step after every 32 updates: replaying the
+    // change feed vs copying the list again
+    {
+        RealTimeAdvancedDS primary, mirror;     // no mode rescans in the way
+        ChangeFeed feed;
+        primary.attachChangeFeed(&feed);
+        for (int i = 0; i < N; i++) primary.pushBack(i);
+        mirror.assignFrom(primary);
+        uint64_t cursor = feed.end();
+        vector<ChangeEvent> batch(256);
+        const int Syncs = 256;
+        for (bool replay : {true, false}) {
+            auto t0 = chrono::steady_clock::now();
+            for (int r = 0; r < Syncs; r++) {
+                for (int i = 0; i < 32; i++) { primary.pushBack(r * 32 + i); primary.popFront(); }
+                if (!replay) { mirror.assignFrom(primary); continue; }
+                for (size_t n; (n = feed.read(cursor, batch.data(), batch.size())); )
+                    for (size_t i = 0; i < n; i++) mirror.applyChange(batch[i]);
+            }
+            cout << left << setw(28) << (replay ? "mirror: replay feed" : "mirror: copy list") << right << " "
+                 << chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / Syncs << " us/sync\n";
+        }
+    }
+
+    // 4M-element queue through 64K segments on disk: RAM stays at ~4 segments
+    {
+        const int M = N * 64;
+        SpillingQueue<> q("/tmp", 1 << 16);
+        auto t0 = chrono::steady_clock::now();
+        for (int i = 0; i < M; i++) q.pushBack(i);
+        auto t1 = chrono::steady_clock::now();
+        long long sink = 0;
+        while (!q.empty()) { sink += q.front(); q.popFront(); }
+        auto t2 = chrono::steady_clock::now();
+        auto mbps = [](uint64_t bytes, auto d) { return bytes / 1e6 / chrono::duration<double>(d).count(); };
+        cout << left << setw(28) << "spilling queue push / pop" << right << " "
+             << chrono::duration<double, nano>(t1 - t0).count() / M << " / "
+             << chrono::duration<double, nano>(t2 - t1).count() / M << " ns/op, write "
+             << mbps(q.bytesWritten(), t1 - t0) << " MB/s, read " << mbps(q.bytesRead(), t2 - t1)
+             << " MB/s (checksum " << sink << ")\n";
+    }
+
+    // pushBack under a 4MB memory budget, per eviction policy, against none; then
+    // cutting the budget of a full container to 1MB at once
+    auto budgeted = [&](auto ds, const char* kind) {
+        using DS = decltype(ds);
+        const int M = N * 4;
+        const char* names[] = {"no budget", "evict oldest", "least frequent", "random"};
+        for (int p = 0; p < 4; p++) {
+            DS d;
+            if (p) d.setMemoryBudget(4 << 20, typename DS::Evict(p - 1));
+            mt19937 gen(6);
+            auto t0 = chrono::steady_clock::now();
+            for (int i = 0; i < M; i++) d.pushBack((int)(gen() % 100000));
+            auto t1 = chrono::steady_clock::now();
+            size_t kept = d.size();
+            if (p) d.setMemoryBudget(1 << 20, typename DS::Evict(p - 1));
+            auto t2 = chrono::steady_clock::now();
+            cout << left << setw(28) << (string(kind) + names[p]) << right << " "
+                 << chrono::duration<double, nano>(t1 - t0).count() / M << " ns/op, kept " << kept;
+            if (p) cout << "; to 1MB " << chrono::duration<double, milli>(t2 - t1).count() << " ms, kept " << d.size();
+            cout << " in " << d.memoryUsed() / 1024 << " KB\n";
+        }
+    };
+    budgeted(AdvancedDS(), "budget: ");
+    budgeted(RealTimeAdvancedDS(), "budget (RT): ");
+
+    // external merge sort of 4M values in 1MB runs, against std::sort in RAM
+    {
+        const int M = N * 64;
+        vector<int> v(M);
+        mt19937 gen(5);
+        for (int &x : v) x = (int)gen();
+        ExternalSorter sorter("/tmp", 1 << 18);
+        for (int x : v) sorter.add(x);
+        long long sink = 0;
+        sorter.finish([&](int x) { sink += x; });
+        auto t0 = chrono::steady_clock::now();
+        sort(v.begin(), v.end());
+        double inRam = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        const ExternalSorter::Stats &st = sorter.stats();
+        cout << left << setw(28) << "external sort" << right << " " << st.runs << " runs, "
+             << (st.bytesWritten + st.bytesRead) / 1e6 << " MB I/O, "
+             << (st.runSeconds + st.mergeSeconds) * 1e3 << " ms (" << st.mbPerSecond() << " MB/s); std::sort "
+             << inRam << " ms (checksum " << sink << ")\n";
+    }
+
+    // replication over a Unix socket: the writer's cost per push, and how long after
+    // the last one the replica has applied everything
+    {
+        ConcurrentAdvancedDS<> q;
+        ReplicationPrimary<> primary(q, "/tmp/advancedds-bench.sock");
+        Replica<> replica("/tmp/advancedds-bench.sock");
+        auto t0 = chrono::steady_clock::now();
+        for (int i = 0; i < N; i++) q.pushBack(i);
+        auto t1 = chrono::steady_clock::now();
+        replica.waitFor(primary.published(), chrono::seconds(10));
+        auto t2 = chrono::steady_clock::now();
+        cout << left << setw(28) << "replicated pushBack" << right << " "
+             << chrono::duration<double, nano>(t1 - t0).count() / N << " ns/op, replica caught up "
+             << chrono::duration<double, milli>(t2 - t1).count() << " ms later\n";
+    }
+}
+*/
+
+// ----------------- Allocation check -----------------
+// Build with -DADVANCEDDS_COUNT_ALLOCS; exits non-zero if a hot path allocates after warm-up.
+/*
+int main() {
+    const int N = 1 << 12, Rounds = 1 << 16;
+    AdvancedDS ds;
+    for (int i = 0; i < N; i++) ds.pushBack(i % 1000);
+    for (int i = 0; i < Rounds; i++) { ds.pushBack(i % 1000); ds.popFront(); }   // warm-up
+
+    size_t before = heapAllocCount();
+    long long sink = 0;
+    for (int i = 0; i < Rounds; i++) {
+        ds.pushBack(i * 37 % 1000);
+        ds.popFront();
+        sink += (long long)ds.getMedian();
+        sink += ds.contains(i % 2000);
+    }
+    size_t allocs = heapAllocCount() - before;
+    cout << "steady-state allocations: " << allocs << " (checksum " << sink << ")\n";
+    return allocs == 0 ? 0 : 1;
+}
+*/
+
+// ----------------- Shared-reader check -----------------
+// Build with -fsanitize=address: readers walk a shared container while the writer
+// splits and merges it with others and removes nodes from those. Pool caching is off,
+// so a node freed under a reader is a use-after-free report, not a recycled block.
+/*
+int main() {
+    SmallPool::setCacheLimit(0);
+    AdvancedDS a;
+    a.setSharedReaders(true);
+    for (int i = 0; i < 4000; i++) a.pushBack(i);
+    atomic<bool> done{false};
+    vector<thread> readers;
+    for (int r = 0; r < 3; r++) readers.emplace_back([&] {
+        SmallPool::setCacheLimit(0);
+        long long sink = 0;
+        while (!done.load(memory_order_relaxed)) {
+            EpochDomain::Guard g;
+            a.walkShared([&](int v) { sink += v; return true; });
+        }
+    });
+    mt19937 gen(3);
+    for (int it = 0; it < 4000; it++) {
+        switch (gen() % 3) {
+        case 0: {                               // split off a tail, trim it, merge it back
+            AdvancedDS r = a.split(gen() % a.size());
+            while (r.size() > 2000) r.popFront();
+            a.merge(r);
+            break;
+        }
+        case 1: {                               // a fresh container takes a's nodes over
+            AdvancedDS b;
+            b.pushBack(0);
+            b.merge(a);
+            while (b.size() > 3000) b.popBack();
+            a.swap(b);
+            break;
+        }
+        case 2: a.split(a.size() - 10).clear(); break;
+        }
+        while (a.size() < 4000) a.pushBack(it);
+    }
+    done = true;
+    for (auto &t : readers) t.join();
+    cout << "shared readers: ok\n";
 }
 */